@@ -0,0 +1,663 @@
+/*
+Drives the applet's menubar code against fake indicator objects
+and reports how long each operation takes.
+
+It links the applet's core library and uses the few menubar
+functions applet-main.h has for it.  After every round of churn it
+checks that the menubar still holds each indicator's entries in
+order, and exits with an error if not.  Run it through "make bench",
+which starts it in a headless X server.
+
+With --discover it instead loads whatever is in the indicator
+directories, the way the applet does when it starts.  Point it at
+fake indicators with the run script from generate-indicators.sh.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include <gtk/gtk.h>
+
+#include "applet-main.h"
+
+/*************
+ * allocation counting
+ *
+ * Every malloc in the process, GLib and GTK included, comes
+ * through here.  glibc keeps its own entry points under these
+ * names so they can be wrapped.  GSlice only shows up when it is
+ * told to use malloc, which "make bench" does with G_SLICE.
+ * ***********/
+
+extern void * __libc_malloc (size_t size);
+extern void * __libc_calloc (size_t n, size_t size);
+extern void * __libc_realloc (void * ptr, size_t size);
+extern void * __libc_memalign (size_t alignment, size_t size);
+
+static volatile guint64 alloc_count = 0;
+
+void *
+malloc (size_t size)
+{
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(n, size);
+}
+
+void *
+realloc (void * ptr, size_t size)
+{
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  return __libc_memalign(alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  return memalign(alignment, size);
+}
+
+int
+posix_memalign (void ** ptr, size_t alignment, size_t size)
+{
+  void * mem;
+
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+
+  mem = memalign(alignment, size);
+  if (mem == NULL) {
+    return ENOMEM;
+  }
+
+  *ptr = mem;
+  return 0;
+}
+
+/*************
+ * fake indicator
+ * ***********/
+
+#define FAKE_INDICATOR_TYPE  (fake_indicator_get_type())
+#define FAKE_INDICATOR(o)    (G_TYPE_CHECK_INSTANCE_CAST((o), FAKE_INDICATOR_TYPE, FakeIndicator))
+
+typedef struct _FakeIndicator      FakeIndicator;
+typedef struct _FakeIndicatorClass FakeIndicatorClass;
+
+struct _FakeIndicator {
+  IndicatorObject parent;
+  GList * entries;              /* in location order */
+  gint position;
+};
+
+struct _FakeIndicatorClass {
+  IndicatorObjectClass parent_class;
+};
+
+GType fake_indicator_get_type (void);
+
+G_DEFINE_TYPE (FakeIndicator, fake_indicator, INDICATOR_OBJECT_TYPE);
+
+static GList *
+fake_indicator_get_entries (IndicatorObject * io)
+{
+  return g_list_copy(FAKE_INDICATOR(io)->entries);
+}
+
+static guint
+fake_indicator_get_location (IndicatorObject * io, IndicatorObjectEntry * entry)
+{
+  return g_list_index(FAKE_INDICATOR(io)->entries, entry);
+}
+
+static gint
+fake_indicator_get_position (IndicatorObject * io)
+{
+  return FAKE_INDICATOR(io)->position;
+}
+
+static void
+entry_free (gpointer data)
+{
+  IndicatorObjectEntry * entry = (IndicatorObjectEntry *)data;
+
+  g_clear_object(&entry->label);
+  g_clear_object(&entry->image);
+  g_clear_object(&entry->menu);
+  g_free((gchar *)entry->accessible_desc);
+  g_free(entry);
+}
+
+static void
+fake_indicator_finalize (GObject * object)
+{
+  g_list_free_full(FAKE_INDICATOR(object)->entries, entry_free);
+
+  G_OBJECT_CLASS(fake_indicator_parent_class)->finalize(object);
+}
+
+static void
+fake_indicator_class_init (FakeIndicatorClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS(klass);
+  IndicatorObjectClass * io_class = INDICATOR_OBJECT_CLASS(klass);
+
+  object_class->finalize = fake_indicator_finalize;
+
+  io_class->get_entries = fake_indicator_get_entries;
+  io_class->get_location = fake_indicator_get_location;
+  io_class->get_position = fake_indicator_get_position;
+}
+
+static void
+fake_indicator_init (FakeIndicator * self G_GNUC_UNUSED)
+{
+}
+
+static IndicatorObjectEntry *
+fake_entry_new (IndicatorObject * io, guint number, guint menu_size)
+{
+  IndicatorObjectEntry * entry = g_new0(IndicatorObjectEntry, 1);
+  gchar * text = g_strdup_printf("Fake %u", number);
+  guint i;
+
+  entry->parent_object = io;
+  entry->label = g_object_ref_sink(gtk_label_new(text));
+  entry->image = g_object_ref_sink(gtk_image_new_from_icon_name("indicator-applet", GTK_ICON_SIZE_MENU));
+  entry->menu = g_object_ref_sink(gtk_menu_new());
+  entry->accessible_desc = text;
+
+  for (i = 0; i < menu_size; i++) {
+    gtk_menu_shell_append(GTK_MENU_SHELL(entry->menu), gtk_menu_item_new_with_label("Item"));
+  }
+
+  gtk_widget_show(GTK_WIDGET(entry->label));
+  gtk_widget_show(GTK_WIDGET(entry->image));
+
+  return entry;
+}
+
+/*************
+ * measurements
+ * ***********/
+
+typedef struct _sample_set_t sample_set_t;
+struct _sample_set_t {
+  const gchar * op;
+  GArray * ns;                  /* gint64 per operation */
+  guint64 allocs;
+};
+
+static gint64 sample_start_ns;
+static guint64 sample_start_allocs;
+
+static gint64
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+static sample_set_t *
+sample_set_new (const gchar * op)
+{
+  sample_set_t * set = g_new0(sample_set_t, 1);
+  set->op = op;
+  set->ns = g_array_new(FALSE, FALSE, sizeof(gint64));
+  return set;
+}
+
+static void
+sample_begin (void)
+{
+  sample_start_allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+  sample_start_ns = now_ns();
+}
+
+static void
+sample_end (sample_set_t * set)
+{
+  gint64 elapsed = now_ns() - sample_start_ns;
+
+  set->allocs += __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - sample_start_allocs;
+  g_array_append_val(set->ns, elapsed);
+}
+
+static gint
+compare_ns (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a;
+  gint64 y = *(const gint64 *)b;
+  return (x > y) - (x < y);
+}
+
+static gint64
+percentile (GArray * sorted, gdouble p)
+{
+  guint index = (guint)(p * (sorted->len - 1) + 0.5);
+  return g_array_index(sorted, gint64, index);
+}
+
+/* One JSON object per line, so results can be appended and
+   compared between runs */
+static void
+sample_set_report (sample_set_t * set, guint entries, guint churn, const gchar * orientation)
+{
+  GArray * ns = set->ns;
+
+  if (ns->len > 0) {
+    g_array_sort(ns, compare_ns);
+    g_print("{\"op\":\"%s\",\"entries\":%u,\"churn\":%u,\"orientation\":\"%s\","
+            "\"count\":%u,\"p50_ns\":%" G_GINT64_FORMAT ",\"p90_ns\":%" G_GINT64_FORMAT ","
+            "\"p99_ns\":%" G_GINT64_FORMAT ",\"max_ns\":%" G_GINT64_FORMAT ","
+            "\"allocs_per_op\":%.1f}\n",
+            set->op, entries, churn, orientation,
+            ns->len, percentile(ns, 0.50), percentile(ns, 0.90),
+            percentile(ns, 0.99), g_array_index(ns, gint64, ns->len - 1),
+            (gdouble)set->allocs / ns->len);
+  }
+
+  g_array_free(ns, TRUE);
+  g_free(set);
+}
+
+/*************
+ * scenarios
+ * ***********/
+
+static gint opt_entries_per_object = 5;
+static gint opt_churn = 10;
+static gint opt_cycles = 50;
+static gint opt_reorients = 20;
+static gint opt_menu_size = 5;
+static gint opt_seed = 1;
+static gchar * opt_entries = NULL;
+static gchar * opt_orientation = NULL;
+static gboolean opt_discover = FALSE;
+static gint opt_duration = 2000;
+
+static GOptionEntry options[] = {
+  { "entries", 'n', 0, G_OPTION_ARG_STRING, &opt_entries, "Comma separated entry counts (default 10,100,1000)", "COUNTS" },
+  { "entries-per-object", 0, 0, G_OPTION_ARG_INT, &opt_entries_per_object, "Entries on each fake indicator", "N" },
+  { "churn", 'c', 0, G_OPTION_ARG_INT, &opt_churn, "Entries replaced and moved per cycle", "N" },
+  { "cycles", 0, 0, G_OPTION_ARG_INT, &opt_cycles, "Churn cycles to run", "N" },
+  { "reorients", 0, 0, G_OPTION_ARG_INT, &opt_reorients, "Orientation flips to run", "N" },
+  { "menu-size", 0, 0, G_OPTION_ARG_INT, &opt_menu_size, "Items in each entry's menu", "N" },
+  { "orientation", 'o', 0, G_OPTION_ARG_STRING, &opt_orientation, "Panel orientation: up, down, left, right or all (default up,left)", "ORIENT" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &opt_seed, "Random seed", "N" },
+  { "discover", 0, 0, G_OPTION_ARG_NONE, &opt_discover, "Load the indicators from the indicator directories", NULL },
+  { "duration", 0, 0, G_OPTION_ARG_INT, &opt_duration, "Milliseconds to keep running after --discover starts loading", "MS" },
+  { NULL }
+};
+
+static guint order_failures = 0;
+
+/* The objects are added in position order, so the menubar should
+   hold every entry of the first one, in list order, then the
+   second one's and so on */
+static void
+check_order (GtkWidget * menubar, GPtrArray * objects, const gchar * after)
+{
+  GList * children = gtk_container_get_children(GTK_CONTAINER(menubar));
+  GList * child = children;
+  guint i;
+
+  for (i = 0; i < objects->len; i++) {
+    FakeIndicator * fake = g_ptr_array_index(objects, i);
+    GList * l;
+
+    for (l = fake->entries; l != NULL; l = l->next, child = child->next) {
+      IndicatorObjectEntry * entry = l->data;
+      GtkWidget * menuitem = gtk_widget_get_ancestor(GTK_WIDGET(entry->label), GTK_TYPE_MENU_ITEM);
+
+      if (child == NULL || child->data != menuitem) {
+        g_printerr("Menubar out of order after %s: '%s' is not at %d\n",
+                   after, entry->accessible_desc,
+                   g_list_position(children, child));
+        order_failures++;
+        g_list_free(children);
+        return;
+      }
+    }
+  }
+
+  if (child != NULL) {
+    g_printerr("Menubar has %u stale items after %s\n", g_list_length(child), after);
+    order_failures++;
+  }
+
+  g_list_free(children);
+}
+
+static void
+run_scenario (guint n_entries, PanelAppletOrient orient, const gchar * orientation)
+{
+  sample_set_t * added = sample_set_new("entry_added");
+  sample_set_t * removed = sample_set_new("entry_removed");
+  sample_set_t * moved = sample_set_new("entry_moved");
+  sample_set_t * flush = sample_set_new("flush");
+  sample_set_t * reorient = sample_set_new("reorient");
+  GPtrArray * objects = g_ptr_array_new_with_free_func(g_object_unref);
+  GRand * rand = g_rand_new_with_seed(opt_seed);
+  GtkWidget * window;
+  GtkWidget * menubar;
+  guint per_object = MAX(opt_entries_per_object, 1);
+  guint n_objects = (n_entries + per_object - 1) / per_object;
+  guint next_number = n_entries;
+  guint i, j;
+
+  window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  menubar = indicator_applet_menubar_new("IndicatorAppletCompleteFactory", orient);
+  gtk_container_add(GTK_CONTAINER(window), menubar);
+  gtk_widget_show_all(window);
+
+  /* Objects start out empty and get their entries one at a time.
+     A higher position goes further left. */
+  for (i = 0; i < n_objects; i++) {
+    FakeIndicator * fake = g_object_new(FAKE_INDICATOR_TYPE, NULL);
+    gchar * name = g_strdup_printf("libfake%u.so", i);
+
+    fake->position = n_objects - i;
+    indicator_applet_menubar_add_indicator(menubar, INDICATOR_OBJECT(fake), name);
+    g_ptr_array_add(objects, fake);
+    g_free(name);
+  }
+
+  for (i = 0; i < n_entries; i++) {
+    FakeIndicator * fake = g_ptr_array_index(objects, i / per_object);
+    IndicatorObjectEntry * entry = fake_entry_new(INDICATOR_OBJECT(fake), i, opt_menu_size);
+
+    fake->entries = g_list_append(fake->entries, entry);
+
+    sample_begin();
+    g_signal_emit_by_name(fake, INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED, entry);
+    sample_end(added);
+  }
+
+  sample_begin();
+  indicator_applet_menubar_flush(menubar);
+  sample_end(flush);
+  check_order(menubar, objects, "adding");
+
+  for (i = 0; i < (guint)opt_cycles; i++) {
+    for (j = 0; j < (guint)opt_churn; j++) {
+      FakeIndicator * fake = g_ptr_array_index(objects, g_rand_int_range(rand, 0, objects->len));
+      guint length = g_list_length(fake->entries);
+      IndicatorObjectEntry * entry;
+      gint old, new;
+
+      if (length == 0) {
+        continue;
+      }
+
+      /* Replace an entry with a new one in the same place, the
+         way an indicator does when it rebuilds, so its menuitem
+         is released and the new one comes from the pool */
+      old = g_rand_int_range(rand, 0, length);
+      entry = g_list_nth_data(fake->entries, old);
+
+      sample_begin();
+      g_signal_emit_by_name(fake, INDICATOR_OBJECT_SIGNAL_ENTRY_REMOVED, entry);
+      sample_end(removed);
+
+      fake->entries = g_list_remove(fake->entries, entry);
+      entry_free(entry);
+      entry = fake_entry_new(INDICATOR_OBJECT(fake), next_number++, opt_menu_size);
+      fake->entries = g_list_insert(fake->entries, entry, old);
+
+      sample_begin();
+      g_signal_emit_by_name(fake, INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED, entry);
+      sample_end(added);
+
+      /* And move another one */
+      old = g_rand_int_range(rand, 0, length);
+      new = g_rand_int_range(rand, 0, length);
+      entry = g_list_nth_data(fake->entries, old);
+      fake->entries = g_list_remove(fake->entries, entry);
+      fake->entries = g_list_insert(fake->entries, entry, new);
+
+      sample_begin();
+      g_signal_emit_by_name(fake, INDICATOR_OBJECT_SIGNAL_ENTRY_MOVED, entry, old, new);
+      sample_end(moved);
+    }
+
+    sample_begin();
+    indicator_applet_menubar_flush(menubar);
+    sample_end(flush);
+    check_order(menubar, objects, "churn");
+
+    while (gtk_events_pending()) {
+      gtk_main_iteration();
+    }
+  }
+
+  for (i = 0; i < (guint)opt_reorients; i++) {
+    orient = (orient == PANEL_APPLET_ORIENT_UP || orient == PANEL_APPLET_ORIENT_DOWN) ?
+        PANEL_APPLET_ORIENT_LEFT : PANEL_APPLET_ORIENT_UP;
+
+    sample_begin();
+    indicator_applet_menubar_reorient(menubar, orient);
+    sample_end(reorient);
+
+    while (gtk_events_pending()) {
+      gtk_main_iteration();
+    }
+  }
+  check_order(menubar, objects, "reorienting");
+
+  sample_set_report(added, n_entries, opt_churn, orientation);
+  sample_set_report(removed, n_entries, opt_churn, orientation);
+  sample_set_report(moved, n_entries, opt_churn, orientation);
+  sample_set_report(flush, n_entries, opt_churn, orientation);
+  sample_set_report(reorient, n_entries, opt_churn, orientation);
+
+  gtk_widget_destroy(window);
+  g_ptr_array_free(objects, TRUE);
+  g_rand_free(rand);
+}
+
+/*************
+ * discovery
+ * ***********/
+
+static GPollFunc default_poll = NULL;
+static sample_set_t * dispatch = NULL;
+static gboolean dispatching = FALSE;
+
+/* Whatever happens between two polls is the main loop at work,
+   so this times every dispatch without touching the sources */
+static gint
+timed_poll (GPollFD * fds, guint nfds, gint timeout)
+{
+  gint ret;
+
+  if (dispatching) {
+    sample_end(dispatch);
+  }
+
+  ret = default_poll(fds, nfds, timeout);
+
+  dispatching = TRUE;
+  sample_begin();
+
+  return ret;
+}
+
+static gboolean
+duration_timeout (gpointer user_data)
+{
+  *(gboolean *)user_data = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+static guint
+menubar_length (GtkWidget * menubar)
+{
+  GList * children = gtk_container_get_children(GTK_CONTAINER(menubar));
+  guint length = g_list_length(children);
+
+  g_list_free(children);
+  return length;
+}
+
+static void
+run_discovery (PanelAppletOrient orient, const gchar * orientation)
+{
+  GtkWidget * window;
+  GtkWidget * menubar;
+  gint indicators;
+  gint64 start, first_entry_ns = -1, loaded_ns = -1;
+  gboolean done = FALSE;
+
+  window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  menubar = indicator_applet_menubar_new("IndicatorAppletCompleteFactory", orient);
+  gtk_container_add(GTK_CONTAINER(window), menubar);
+  gtk_widget_show_all(window);
+
+  dispatch = sample_set_new("dispatch");
+  default_poll = g_main_context_get_poll_func(NULL);
+  g_main_context_set_poll_func(NULL, timed_poll);
+
+  start = now_ns();
+  indicators = indicator_applet_menubar_load(menubar);
+  g_timeout_add(opt_duration, duration_timeout, &done);
+
+  while (!done) {
+    g_main_context_iteration(NULL, TRUE);
+
+    if (first_entry_ns < 0 && menubar_length(menubar) > 0) {
+      first_entry_ns = now_ns() - start;
+    }
+    if (loaded_ns < 0 && indicator_applet_menubar_loading(menubar) == 0) {
+      loaded_ns = now_ns() - start;
+    }
+  }
+
+  g_main_context_set_poll_func(NULL, default_poll);
+  dispatching = FALSE;
+
+  g_print("{\"op\":\"startup\",\"indicators\":%d,\"orientation\":\"%s\","
+          "\"first_entry_ns\":%" G_GINT64_FORMAT ",\"loaded_ns\":%" G_GINT64_FORMAT ","
+          "\"entries\":%d}\n",
+          indicators, orientation, first_entry_ns, loaded_ns,
+          menubar_length(menubar));
+  sample_set_report(dispatch, menubar_length(menubar), 0, orientation);
+  dispatch = NULL;
+
+  gtk_widget_destroy(window);
+}
+
+static gboolean
+parse_orientation (const gchar * name, PanelAppletOrient * orient)
+{
+  static const struct {
+    const gchar * name;
+    PanelAppletOrient orient;
+  } orients[] = {
+    { "up",    PANEL_APPLET_ORIENT_UP },
+    { "down",  PANEL_APPLET_ORIENT_DOWN },
+    { "left",  PANEL_APPLET_ORIENT_LEFT },
+    { "right", PANEL_APPLET_ORIENT_RIGHT }
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(orients); i++) {
+    if (g_strcmp0(name, orients[i].name) == 0) {
+      *orient = orients[i].orient;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+int
+main (int argc, char ** argv)
+{
+  GOptionContext * context;
+  GError * error = NULL;
+  gchar ** counts;
+  gchar ** orientations;
+  guint i, j;
+
+  if (g_strcmp0(g_getenv("G_SLICE"), "always-malloc") != 0) {
+    g_printerr("G_SLICE=always-malloc is not set, slice allocations are not counted\n");
+  }
+
+  context = g_option_context_new("- benchmark the indicator applet menubar");
+  g_option_context_add_main_entries(context, options, NULL);
+  g_option_context_add_group(context, gtk_get_option_group(TRUE));
+
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  counts = g_strsplit(opt_entries != NULL ? opt_entries : "10,100,1000", ",", -1);
+  orientations = g_strsplit(opt_orientation == NULL ? "up,left" :
+                            g_strcmp0(opt_orientation, "all") == 0 ? "up,down,left,right" :
+                            opt_orientation, ",", -1);
+
+  for (i = 0; orientations[i] != NULL; i++) {
+    PanelAppletOrient orient;
+
+    if (!parse_orientation(orientations[i], &orient)) {
+      g_printerr("Unknown orientation '%s'\n", orientations[i]);
+      return 1;
+    }
+
+    if (opt_discover) {
+      run_discovery(orient, orientations[i]);
+      continue;
+    }
+
+    for (j = 0; counts[j] != NULL; j++) {
+      guint n = (guint)g_ascii_strtoull(counts[j], NULL, 10);
+
+      if (n == 0) {
+        g_printerr("Bad entry count '%s'\n", counts[j]);
+        return 1;
+      }
+
+      run_scenario(n, orient, orientations[i]);
+    }
+  }
+
+  g_strfreev(counts);
+  g_strfreev(orientations);
+
+  return order_failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+/*
+A fake indicator service for load testing the applet.  It owns a
+name on the session bus and exports the actions and menu that an
+indicator service file points the applet at, with knobs for how
+slowly it starts and how busy its label is.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gio/gio.h>
+
+#define HEADER_ACTION  "_header"
+
+static gchar * opt_name = NULL;
+static gchar * opt_object_path = NULL;
+static gchar * opt_profile = "desktop";
+static gint opt_menu_size = 5;
+static gint opt_label_interval = 0;
+static gint opt_flap_interval = 0;
+static gint opt_startup_delay = 0;
+
+static GOptionEntry options[] = {
+  { "name", 0, 0, G_OPTION_ARG_STRING, &opt_name, "Bus name to own", "NAME" },
+  { "object-path", 0, 0, G_OPTION_ARG_STRING, &opt_object_path, "Object path of the actions", "PATH" },
+  { "profile", 0, 0, G_OPTION_ARG_STRING, &opt_profile, "Profile whose menu is exported (default desktop)", "PROFILE" },
+  { "menu-size", 0, 0, G_OPTION_ARG_INT, &opt_menu_size, "Items in the menu", "N" },
+  { "label-interval", 0, 0, G_OPTION_ARG_INT, &opt_label_interval, "Milliseconds between label changes, 0 for never", "MS" },
+  { "flap-interval", 0, 0, G_OPTION_ARG_INT, &opt_flap_interval, "Milliseconds between hiding and showing, 0 for never", "MS" },
+  { "startup-delay", 0, 0, G_OPTION_ARG_INT, &opt_startup_delay, "Milliseconds to wait before taking the name", "MS" },
+  { NULL }
+};
+
+typedef struct _service_t service_t;
+struct _service_t {
+  GMainLoop * loop;
+  GSimpleActionGroup * actions;
+  GMenu * menu;
+  guint label_count;
+  gboolean visible;
+};
+
+static GVariant *
+header_state (service_t * service)
+{
+  GVariantBuilder builder;
+  gchar * label = g_strdup_printf("%s %u", opt_name, service->label_count);
+
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&builder, "{sv}", "label", g_variant_new_string(label));
+  g_variant_builder_add(&builder, "{sv}", "accessible-desc", g_variant_new_string(label));
+  g_variant_builder_add(&builder, "{sv}", "visible", g_variant_new_boolean(service->visible));
+  g_free(label);
+
+  return g_variant_builder_end(&builder);
+}
+
+static void
+header_update (service_t * service)
+{
+  GAction * action = g_action_map_lookup_action(G_ACTION_MAP(service->actions), HEADER_ACTION);
+  g_simple_action_set_state(G_SIMPLE_ACTION(action), header_state(service));
+}
+
+static gboolean
+label_timeout (gpointer user_data)
+{
+  service_t * service = user_data;
+
+  service->label_count++;
+  header_update(service);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+flap_timeout (gpointer user_data)
+{
+  service_t * service = user_data;
+
+  service->visible = !service->visible;
+  header_update(service);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+service_build (service_t * service)
+{
+  GMenu * submenu = g_menu_new();
+  GMenuItem * root;
+  GSimpleAction * action;
+  gint i;
+
+  service->visible = TRUE;
+  service->actions = g_simple_action_group_new();
+
+  action = g_simple_action_new_stateful(HEADER_ACTION, NULL, header_state(service));
+  g_action_map_add_action(G_ACTION_MAP(service->actions), G_ACTION(action));
+  g_object_unref(action);
+
+  action = g_simple_action_new("item", G_VARIANT_TYPE_INT32);
+  g_action_map_add_action(G_ACTION_MAP(service->actions), G_ACTION(action));
+  g_object_unref(action);
+
+  for (i = 0; i < opt_menu_size; i++) {
+    gchar * label = g_strdup_printf("Item %d", i);
+    GMenuItem * item = g_menu_item_new(label, NULL);
+
+    g_menu_item_set_action_and_target_value(item, "indicator.item", g_variant_new_int32(i));
+    g_menu_append_item(submenu, item);
+    g_object_unref(item);
+    g_free(label);
+  }
+
+  /* The applet takes the header from the root item's action
+     and the menu from its submenu */
+  root = g_menu_item_new(NULL, "indicator." HEADER_ACTION);
+  g_menu_item_set_attribute(root, "x-canonical-type", "s", "com.canonical.indicator.root");
+  g_menu_item_set_submenu(root, G_MENU_MODEL(submenu));
+
+  service->menu = g_menu_new();
+  g_menu_append_item(service->menu, root);
+
+  g_object_unref(root);
+  g_object_unref(submenu);
+}
+
+static void
+bus_acquired (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+  service_t * service = user_data;
+  gchar * menu_path = g_strconcat(opt_object_path, "/", opt_profile, NULL);
+  GError * error = NULL;
+
+  if (g_dbus_connection_export_action_group(connection, opt_object_path,
+                                            G_ACTION_GROUP(service->actions), &error) == 0 ||
+      g_dbus_connection_export_menu_model(connection, menu_path,
+                                          G_MENU_MODEL(service->menu), &error) == 0) {
+    g_warning("Unable to export %s: %s", opt_name, error->message);
+    g_error_free(error);
+  }
+
+  g_free(menu_path);
+}
+
+static void
+name_lost (GDBusConnection * connection, const gchar * name, gpointer user_data)
+{
+  service_t * service = user_data;
+
+  g_warning("Lost the name %s", name);
+  g_main_loop_quit(service->loop);
+}
+
+int
+main (int argc, char ** argv)
+{
+  GOptionContext * context;
+  GError * error = NULL;
+  service_t service = { 0 };
+
+  context = g_option_context_new("- a fake indicator service");
+  g_option_context_add_main_entries(context, options, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  if (opt_name == NULL || opt_object_path == NULL ||
+      !g_dbus_is_name(opt_name) || !g_variant_is_object_path(opt_object_path)) {
+    g_printerr("A bus name and an object path are needed\n");
+    return 1;
+  }
+
+  /* A service that is slow to start is one that is slow to
+     take its name, which is what the applet waits for */
+  if (opt_startup_delay > 0) {
+    g_usleep(opt_startup_delay * 1000);
+  }
+
+  service.loop = g_main_loop_new(NULL, FALSE);
+  service_build(&service);
+
+  if (opt_label_interval > 0) {
+    g_timeout_add(opt_label_interval, label_timeout, &service);
+  }
+  if (opt_flap_interval > 0) {
+    g_timeout_add(opt_flap_interval, flap_timeout, &service);
+  }
+
+  g_bus_own_name(G_BUS_TYPE_SESSION, opt_name, G_BUS_NAME_OWNER_FLAGS_NONE,
+                 bus_acquired, NULL, name_lost, &service, NULL);
+
+  g_main_loop_run(service.loop);
+
+  g_main_loop_unref(service.loop);
+  g_object_unref(service.menu);
+  g_object_unref(service.actions);
+
+  return 0;
+}
@@ -0,0 +1,328 @@
+/*
+A fake indicator module for load testing the applet.  Copies of it
+are put in a module directory by generate-indicators.sh, and each
+copy reads its settings from the group named after its file in the
+key file given by $FAKE_INDICATOR_CONFIG, falling back to the
+"Defaults" group.
+
+Settings, all times in milliseconds:
+  Entries          - number of entries
+  MenuSize         - items in each entry's menu
+  LabelInterval    - how often one of the labels changes, 0 for never
+  FlapInterval     - how often an entry is removed or added back, 0 for never
+  ConstructorDelay - time spent when the module is loaded
+  InitDelay        - time spent creating the indicator object
+  Seed             - seed for picking which entries change
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <libindicator/indicator.h>
+#include <libindicator/indicator-object.h>
+
+#define DEFAULTS_GROUP  "Defaults"
+
+typedef struct _fake_config_t fake_config_t;
+struct _fake_config_t {
+  gchar * group;
+  gint entries;
+  gint menu_size;
+  gint label_interval;
+  gint flap_interval;
+  gint constructor_delay;
+  gint init_delay;
+  gint seed;
+};
+
+static fake_config_t config = {
+  NULL, 3, 5, 0, 0, 0, 0, 1
+};
+
+static gint
+config_get (GKeyFile * keyfile, const gchar * key, gint fallback)
+{
+  const gchar * groups[] = { config.group, DEFAULTS_GROUP };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(groups); i++) {
+    if (g_key_file_has_key(keyfile, groups[i], key, NULL)) {
+      return MAX(g_key_file_get_integer(keyfile, groups[i], key, NULL), 0);
+    }
+  }
+
+  return fallback;
+}
+
+/* The group is the file name of this copy of the module, less
+   the "lib" prefix and the suffix: "libfake-3.so" is "fake-3" */
+static gchar *
+config_group (void)
+{
+  Dl_info info;
+  gchar * base, * group;
+
+  if (dladdr((void *)config_get, &info) == 0 || info.dli_fname == NULL) {
+    return g_strdup(DEFAULTS_GROUP);
+  }
+
+  base = g_path_get_basename(info.dli_fname);
+  group = g_strdup(g_str_has_prefix(base, "lib") ? base + 3 : base);
+  if (g_str_has_suffix(group, "." G_MODULE_SUFFIX)) {
+    group[strlen(group) - strlen("." G_MODULE_SUFFIX)] = '\0';
+  }
+  g_free(base);
+
+  return group;
+}
+
+/* Runs when the applet maps the module, which it does
+   off the main thread */
+static void __attribute__((constructor))
+fake_config_load (void)
+{
+  const gchar * filename = g_getenv("FAKE_INDICATOR_CONFIG");
+  GKeyFile * keyfile = g_key_file_new();
+
+  config.group = config_group();
+
+  if (filename != NULL && g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_NONE, NULL)) {
+    config.entries = config_get(keyfile, "Entries", config.entries);
+    config.menu_size = config_get(keyfile, "MenuSize", config.menu_size);
+    config.label_interval = config_get(keyfile, "LabelInterval", config.label_interval);
+    config.flap_interval = config_get(keyfile, "FlapInterval", config.flap_interval);
+    config.constructor_delay = config_get(keyfile, "ConstructorDelay", config.constructor_delay);
+    config.init_delay = config_get(keyfile, "InitDelay", config.init_delay);
+    config.seed = config_get(keyfile, "Seed", config.seed);
+  }
+
+  g_key_file_free(keyfile);
+
+  if (config.constructor_delay > 0) {
+    g_usleep(config.constructor_delay * 1000);
+  }
+}
+
+/*************
+ * the indicator
+ * ***********/
+
+typedef struct _FakeIndicator FakeIndicator;
+typedef struct _FakeIndicatorClass FakeIndicatorClass;
+
+struct _FakeIndicator {
+  IndicatorObject parent;
+  IndicatorObjectEntry * entries;
+  gboolean * shown;
+  guint n_entries;
+  guint label_count;
+  guint label_id;
+  guint flap_id;
+  GRand * rand;
+};
+
+struct _FakeIndicatorClass {
+  IndicatorObjectClass parent_class;
+};
+
+static GType fake_indicator_get_type (void);
+static gpointer fake_indicator_parent_class = NULL;
+
+#define FAKE_INDICATOR(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), fake_indicator_get_type(), FakeIndicator))
+
+static GList *
+fake_indicator_get_entries (IndicatorObject * io)
+{
+  FakeIndicator * self = FAKE_INDICATOR(io);
+  GList * entries = NULL;
+  guint i;
+
+  for (i = self->n_entries; i > 0; i--) {
+    if (self->shown[i - 1]) {
+      entries = g_list_prepend(entries, &self->entries[i - 1]);
+    }
+  }
+
+  return entries;
+}
+
+static guint
+fake_indicator_get_location (IndicatorObject * io, IndicatorObjectEntry * entry)
+{
+  FakeIndicator * self = FAKE_INDICATOR(io);
+  guint location = 0;
+  guint i;
+
+  for (i = 0; i < self->n_entries && &self->entries[i] != entry; i++) {
+    if (self->shown[i]) {
+      location++;
+    }
+  }
+
+  return location;
+}
+
+static gboolean
+label_timeout (gpointer user_data)
+{
+  FakeIndicator * self = FAKE_INDICATOR(user_data);
+  IndicatorObjectEntry * entry = &self->entries[g_rand_int_range(self->rand, 0, self->n_entries)];
+  gchar * text = g_strdup_printf("%s %u", config.group, ++self->label_count);
+
+  gtk_label_set_text(entry->label, text);
+  g_free(text);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+flap_timeout (gpointer user_data)
+{
+  FakeIndicator * self = FAKE_INDICATOR(user_data);
+  guint i = g_rand_int_range(self->rand, 0, self->n_entries);
+
+  self->shown[i] = !self->shown[i];
+  g_signal_emit_by_name(self, self->shown[i] ? INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED :
+                                               INDICATOR_OBJECT_SIGNAL_ENTRY_REMOVED,
+                        &self->entries[i]);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+fake_indicator_init (FakeIndicator * self)
+{
+  guint i, j;
+
+  if (config.init_delay > 0) {
+    g_usleep(config.init_delay * 1000);
+  }
+
+  self->n_entries = config.entries;
+  self->entries = g_new0(IndicatorObjectEntry, self->n_entries);
+  self->shown = g_new0(gboolean, self->n_entries);
+  self->rand = g_rand_new_with_seed(config.seed);
+
+  for (i = 0; i < self->n_entries; i++) {
+    IndicatorObjectEntry * entry = &self->entries[i];
+    gchar * text = g_strdup_printf("%s %u", config.group, i);
+
+    entry->label = g_object_ref_sink(gtk_label_new(text));
+    entry->menu = g_object_ref_sink(gtk_menu_new());
+    entry->accessible_desc = g_strdup(text);
+    gtk_widget_show(GTK_WIDGET(entry->label));
+
+    for (j = 0; j < (guint)config.menu_size; j++) {
+      gchar * item = g_strdup_printf("Item %u", j);
+      GtkWidget * menuitem = gtk_menu_item_new_with_label(item);
+      gtk_menu_shell_append(GTK_MENU_SHELL(entry->menu), menuitem);
+      gtk_widget_show(menuitem);
+      g_free(item);
+    }
+
+    self->shown[i] = TRUE;
+    g_free(text);
+  }
+
+  if (self->n_entries > 0 && config.label_interval > 0) {
+    self->label_id = g_timeout_add(config.label_interval, label_timeout, self);
+  }
+  if (self->n_entries > 0 && config.flap_interval > 0) {
+    self->flap_id = g_timeout_add(config.flap_interval, flap_timeout, self);
+  }
+}
+
+static void
+fake_indicator_dispose (GObject * object)
+{
+  FakeIndicator * self = FAKE_INDICATOR(object);
+
+  if (self->label_id != 0) {
+    g_source_remove(self->label_id);
+    self->label_id = 0;
+  }
+  if (self->flap_id != 0) {
+    g_source_remove(self->flap_id);
+    self->flap_id = 0;
+  }
+
+  G_OBJECT_CLASS(fake_indicator_parent_class)->dispose(object);
+}
+
+static void
+fake_indicator_finalize (GObject * object)
+{
+  FakeIndicator * self = FAKE_INDICATOR(object);
+  guint i;
+
+  for (i = 0; i < self->n_entries; i++) {
+    g_object_unref(self->entries[i].label);
+    g_object_unref(self->entries[i].menu);
+    g_free((gchar *)self->entries[i].accessible_desc);
+  }
+  g_free(self->entries);
+  g_free(self->shown);
+  g_rand_free(self->rand);
+
+  G_OBJECT_CLASS(fake_indicator_parent_class)->finalize(object);
+}
+
+static void
+fake_indicator_class_init (FakeIndicatorClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS(klass);
+  IndicatorObjectClass * io_class = INDICATOR_OBJECT_CLASS(klass);
+
+  fake_indicator_parent_class = g_type_class_peek_parent(klass);
+
+  object_class->dispose = fake_indicator_dispose;
+  object_class->finalize = fake_indicator_finalize;
+
+  io_class->get_entries = fake_indicator_get_entries;
+  io_class->get_location = fake_indicator_get_location;
+}
+
+/* Every copy of the module is loaded into the same process, so
+   each one registers its type under its own name */
+static GType
+fake_indicator_get_type (void)
+{
+  static GType type = 0;
+
+  if (type == 0) {
+    gchar * name = g_strconcat("FakeIndicator-", config.group, NULL);
+
+    g_strcanon(name, G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "-_+", '_');
+    type = g_type_register_static_simple(INDICATOR_OBJECT_TYPE, name,
+                                         sizeof(FakeIndicatorClass),
+                                         (GClassInitFunc)fake_indicator_class_init,
+                                         sizeof(FakeIndicator),
+                                         (GInstanceInitFunc)fake_indicator_init,
+                                         0);
+    g_free(name);
+  }
+
+  return type;
+}
+
+INDICATOR_SET_VERSION
+INDICATOR_SET_TYPE(fake_indicator_get_type())
@@ -0,0 +1,161 @@
+#!/bin/sh
+#
+# Writes a directory of fake indicator modules and indicator service
+# files for the applet to load, and a run script that starts the
+# services on a private session bus and points the applet at them.
+#
+#   generate-indicators.sh [options] OUTDIR
+#   OUTDIR/run.sh COMMAND [ARGS...]
+#
+# Everything that changes is driven by seeded timers, so two runs
+# of the same scenario see the same sequence of events.
+
+usage() {
+	cat <<EOF
+Usage: $0 [options] OUTDIR
+
+  --scenario=NAME           start from a preset: plain, slow or churn
+  --modules=N               number of indicator modules
+  --services=N              number of indicator services
+  --entries=N               entries on each module
+  --menu-size=N             items in each menu
+  --label-interval=MS       time between label changes, 0 for never
+  --flap-interval=MS        time between entries going away or coming back
+  --constructor-delay=MS    time each module takes to load
+  --init-delay=MS           time each module takes to create its indicator
+  --startup-delay=MS        time each service takes to appear on the bus
+  --seed=N                  random seed
+  --builddir=DIR            where the fakes were built (default: this directory)
+EOF
+	exit 1
+}
+
+modules=10
+services=5
+entries=3
+menu_size=5
+label_interval=0
+flap_interval=0
+constructor_delay=0
+init_delay=0
+startup_delay=0
+seed=1
+builddir=$(cd "$(dirname "$0")" && pwd)
+outdir=
+
+scenario() {
+	case "$1" in
+	plain)
+		;;
+	slow)
+		constructor_delay=200
+		init_delay=20
+		startup_delay=500
+		;;
+	churn)
+		label_interval=50
+		flap_interval=100
+		;;
+	*)
+		echo "Unknown scenario '$1'" >&2
+		usage
+		;;
+	esac
+}
+
+for arg in "$@"; do
+	value=${arg#*=}
+	case "$arg" in
+	--scenario=*)          scenario "$value" ;;
+	--modules=*)           modules=$value ;;
+	--services=*)          services=$value ;;
+	--entries=*)           entries=$value ;;
+	--menu-size=*)         menu_size=$value ;;
+	--label-interval=*)    label_interval=$value ;;
+	--flap-interval=*)     flap_interval=$value ;;
+	--constructor-delay=*) constructor_delay=$value ;;
+	--init-delay=*)        init_delay=$value ;;
+	--startup-delay=*)     startup_delay=$value ;;
+	--seed=*)              seed=$value ;;
+	--builddir=*)          builddir=$value ;;
+	-*)                    usage ;;
+	*)                     outdir=$arg ;;
+	esac
+done
+
+[ -n "$outdir" ] || usage
+
+module="$builddir/.libs/libfake-indicator.so"
+service="$builddir/fake-indicator-service"
+
+if [ ! -f "$module" ] || [ ! -x "$service" ]; then
+	echo "Build the fakes first with \"make -C bench fakes\"" >&2
+	exit 1
+fi
+
+rm -rf "$outdir"
+mkdir -p "$outdir/modules" "$outdir/services" "$outdir/cache"
+outdir=$(cd "$outdir" && pwd)
+
+# Every module gets its own copy rather than a link, as the
+# dynamic linker would hand back the same one for all of them
+config="$outdir/fake-indicators.conf"
+cat > "$config" <<EOF
+[Defaults]
+Entries=$entries
+MenuSize=$menu_size
+LabelInterval=$label_interval
+FlapInterval=$flap_interval
+ConstructorDelay=$constructor_delay
+InitDelay=$init_delay
+EOF
+
+i=0
+while [ $i -lt "$modules" ]; do
+	cp "$module" "$outdir/modules/libfake-$i.so"
+	printf '\n[fake-%d]\nSeed=%d\n' $i $((seed + i)) >> "$config"
+	i=$((i + 1))
+done
+
+starts="$outdir/start-services.sh"
+printf '#!/bin/sh\n' > "$starts"
+
+i=0
+while [ $i -lt "$services" ]; do
+	name="com.canonical.indicator.fake$i"
+	path="/com/canonical/indicator/fake$i"
+
+	cat > "$outdir/services/$name" <<EOF
+[Indicator Service]
+Name=fake$i
+ObjectPath=$path
+Position=$((100 + i))
+
+[desktop]
+ObjectPath=$path/desktop
+EOF
+
+	# Stagger the timers so the services don't all fire at once
+	label=0
+	flap=0
+	[ "$label_interval" -gt 0 ] && label=$((label_interval + i))
+	[ "$flap_interval" -gt 0 ] && flap=$((flap_interval + i))
+
+	echo "\"$service\" --name=$name --object-path=$path --menu-size=$menu_size" \
+	     "--label-interval=$label --flap-interval=$flap --startup-delay=$startup_delay &" >> "$starts"
+	i=$((i + 1))
+done
+
+cat > "$outdir/run.sh" <<EOF
+#!/bin/sh
+# Runs a command against the fake indicators in $outdir
+export INDICATOR_APPLET_MODULE_DIR="$outdir/modules"
+export INDICATOR_APPLET_SERVICE_DIR="$outdir/services"
+export FAKE_INDICATOR_CONFIG="$config"
+export XDG_CACHE_HOME="$outdir/cache"
+exec dbus-run-session -- sh -c '. "$starts"; "\$@"; status=\$?; kill \$(jobs -p) 2>/dev/null; exit \$status' run "\$@"
+EOF
+
+chmod +x "$starts" "$outdir/run.sh"
+
+echo "Wrote $modules modules and $services services to $outdir"
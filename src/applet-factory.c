@@ -0,0 +1,27 @@
+/*
+The panel applet factory for one of the indicator applets.  Every
+variant is built from this file with its own INDICATOR_APPLET_FACTORY,
+and the shared code picks its settings by that id.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+
+#include "applet-main.h"
+
+PANEL_APPLET_IN_PROCESS_FACTORY (INDICATOR_APPLET_FACTORY,
+               PANEL_TYPE_APPLET,
+               indicator_applet_fill, INDICATOR_APPLET_FACTORY);
@@ -0,0 +1,339 @@
+/*
+A log of recent events kept in memory, and only written out
+when someone asks for it.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <gio/gio.h>
+
+#include "applet-log.h"
+
+/* Every event is a fixed size record in a ring that keeps the
+   most recent ones.  Only the format and its arguments are kept,
+   and the text is made when the ring is written out, so logging
+   costs about as much as filling in the record.
+
+   The formats take %s, %d, %u, %p and %%, with no flags, width
+   or length, and only the first few arguments are kept.  Strings
+   are interned, so they should come from a small set like the
+   names of the indicators. */
+#define LOG_RECORDS   1024      /* a power of two */
+#define LOG_MAX_ARGS  3
+
+#define LOG_OBJECT_PATH  "/com/canonical/indicator/applet"
+#define LOG_INTERFACE    "com.canonical.indicator.applet.Log"
+
+typedef union _log_arg_t log_arg_t;
+union _log_arg_t {
+  gint i;
+  guint u;
+  gconstpointer p;
+  const gchar * s;
+};
+
+typedef struct _log_record_t log_record_t;
+struct _log_record_t {
+  gint64 time;
+  const gchar * log_name;       /* NULL for the whole process */
+  const gchar * format;
+  log_arg_t args[LOG_MAX_ARGS];
+};
+
+static log_record_t records[LOG_RECORDS];
+static gint records_written = 0;
+
+/* The applets in this process, each of which gets its own file */
+static GPtrArray * log_names = NULL;
+
+typedef struct _log_report_t log_report_t;
+struct _log_report_t {
+  const gchar * log_name;
+  AppletLogReportFunc func;
+  gpointer user_data;
+};
+
+static GSList * log_reports = NULL;
+
+/**
+ * applet_log:
+ * @log_name: the log of the applet this is about, or %NULL
+ * @format: a string literal in the printf style
+ *
+ * Remembers an event.  Safe to call from any thread; a record
+ * being written as the ring comes round to it again may be
+ * garbled, which is the price of not taking a lock.
+ *
+ * Any other conversion is refused, since its argument can't be
+ * read without knowing its type.
+ */
+void
+applet_log (const gchar * log_name, const gchar * format, ...)
+{
+  guint slot = (guint)g_atomic_int_add(&records_written, 1) & (LOG_RECORDS - 1);
+  log_record_t * record = &records[slot];
+  const gchar * c = format;
+  guint n = 0;
+  va_list args;
+
+  record->time = g_get_monotonic_time();
+  record->log_name = log_name;
+  record->format = format;
+
+  va_start(args, format);
+  while (n < LOG_MAX_ARGS && (c = strchr(c, '%')) != NULL && c[1] != '\0') {
+    switch (c[1]) {
+    case 's':
+      record->args[n++].s = g_intern_string(va_arg(args, const gchar *));
+      break;
+    case 'd':
+      record->args[n++].i = va_arg(args, gint);
+      break;
+    case 'u':
+      record->args[n++].u = va_arg(args, guint);
+      break;
+    case 'p':
+      record->args[n++].p = va_arg(args, gconstpointer);
+      break;
+    case '%':
+      break;
+    default:
+      va_end(args);
+      g_return_if_reached();
+    }
+    c += 2;
+  }
+  va_end(args);
+}
+
+static void
+record_format (GString * out, const log_record_t * record)
+{
+  const gchar * c;
+  guint n = 0;
+
+  g_string_append_printf(out, "%" G_GINT64_FORMAT ".%06d ",
+                         record->time / G_USEC_PER_SEC,
+                         (gint)(record->time % G_USEC_PER_SEC));
+
+  for (c = record->format; *c != '\0'; c++) {
+    if (c[0] != '%' || c[1] == '\0' || (c[1] != '%' && n >= LOG_MAX_ARGS)) {
+      g_string_append_c(out, *c);
+      continue;
+    }
+
+    switch (*++c) {
+    case 's': {
+      const gchar * s = record->args[n++].s;
+      g_string_append(out, s != NULL ? s : "(null)");
+      break;
+    }
+    case 'd':
+      g_string_append_printf(out, "%d", record->args[n++].i);
+      break;
+    case 'u':
+      g_string_append_printf(out, "%u", record->args[n++].u);
+      break;
+    case 'p':
+      g_string_append_printf(out, "%p", record->args[n++].p);
+      break;
+    default:
+      g_string_append_c(out, '%');
+      if (*c != '%') {
+        g_string_append_c(out, *c);
+      }
+      break;
+    }
+  }
+
+  g_string_append_c(out, '\n');
+}
+
+/**
+ * applet_log_dump:
+ *
+ * Writes the events in the ring, oldest first, to each applet's
+ * log file in the user's cache directory.  Events that aren't
+ * about any one applet go in all of them.  The applet's reports
+ * follow the events.
+ *
+ * Return value: the files written, free with g_strfreev()
+ */
+gchar **
+applet_log_dump (void)
+{
+  GPtrArray * files = g_ptr_array_new();
+  guint written = (guint)g_atomic_int_get(&records_written);
+  guint count = MIN(written, LOG_RECORDS);
+  GSList * l;
+  guint i, j;
+
+  for (i = 0; log_names != NULL && i < log_names->len; i++) {
+    const gchar * log_name = g_ptr_array_index(log_names, i);
+    gchar * path = g_build_filename(g_get_user_cache_dir(), log_name, NULL);
+    GString * out = g_string_new(NULL);
+    GError * error = NULL;
+
+    for (j = written - count; j != written; j++) {
+      const log_record_t * record = &records[j & (LOG_RECORDS - 1)];
+
+      if (record->log_name == NULL || record->log_name == log_name) {
+        record_format(out, record);
+      }
+    }
+
+    for (l = log_reports; l != NULL; l = g_slist_next(l)) {
+      const log_report_t * report = l->data;
+
+      if (report->log_name == log_name) {
+        report->func(out, report->user_data);
+      }
+    }
+
+    if (g_file_set_contents(path, out->str, out->len, &error)) {
+      g_ptr_array_add(files, path);
+    } else {
+      g_warning("Unable to write log '%s': %s", path, error->message);
+      g_error_free(error);
+      g_free(path);
+    }
+
+    g_string_free(out, TRUE);
+  }
+
+  g_ptr_array_add(files, NULL);
+  return (gchar **)g_ptr_array_free(files, FALSE);
+}
+
+/*************
+ * asking for the log
+ * ***********/
+
+static const gchar introspection_xml[] =
+  "<node>"
+  "  <interface name='" LOG_INTERFACE "'>"
+  "    <method name='Dump'>"
+  "      <arg type='as' name='files' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+static void
+method_call (GDBusConnection * connection, const gchar * sender,
+             const gchar * object_path, const gchar * interface_name,
+             const gchar * method_name, GVariant * parameters,
+             GDBusMethodInvocation * invocation, gpointer user_data)
+{
+  gchar ** files = applet_log_dump();
+
+  g_dbus_method_invocation_return_value(invocation, g_variant_new("(^as)", files));
+  g_strfreev(files);
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+  method_call, NULL, NULL
+};
+
+static void
+bus_ready (GObject * source, GAsyncResult * res, gpointer user_data)
+{
+  GError * error = NULL;
+  GDBusConnection * connection = g_bus_get_finish(res, &error);
+  GDBusNodeInfo * info;
+
+  if (connection == NULL) {
+    g_warning("Unable to get the session bus: %s", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  info = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+  if (g_dbus_connection_register_object(connection, LOG_OBJECT_PATH,
+                                        info->interfaces[0], &interface_vtable,
+                                        NULL, NULL, &error) == 0) {
+    g_warning("Unable to export the log: %s", error->message);
+    g_error_free(error);
+  }
+
+  g_dbus_node_info_unref(info);
+  g_object_unref(connection);
+}
+
+/**
+ * applet_log_init:
+ * @log_name: file name of an applet's log
+ *
+ * Gives the applet a log file.  Events for it are logged with
+ * this same string, not a copy.  The first one also puts the log
+ * object on the session bus, whose Dump method asks for the logs.
+ * There is no signal for it, as the panel and the other applets
+ * in it share the process.
+ */
+void
+applet_log_init (const gchar * log_name)
+{
+  guint i;
+
+  if (log_names == NULL) {
+    log_names = g_ptr_array_new();
+    g_bus_get(G_BUS_TYPE_SESSION, NULL, bus_ready, NULL);
+  }
+
+  for (i = 0; i < log_names->len; i++) {
+    if (g_ptr_array_index(log_names, i) == log_name) {
+      return;
+    }
+  }
+
+  g_ptr_array_add(log_names, (gpointer)log_name);
+}
+
+/**
+ * applet_log_add_report:
+ * @log_name: the log the report goes in
+ * @func: writes the report
+ * @user_data: for @func
+ *
+ * Has @func describe something in every dump of the log,
+ * until applet_log_remove_report() is called.
+ */
+void
+applet_log_add_report (const gchar * log_name, AppletLogReportFunc func, gpointer user_data)
+{
+  log_report_t * report = g_new0(log_report_t, 1);
+
+  report->log_name = log_name;
+  report->func = func;
+  report->user_data = user_data;
+
+  log_reports = g_slist_append(log_reports, report);
+}
+
+void
+applet_log_remove_report (AppletLogReportFunc func, gpointer user_data)
+{
+  GSList * l;
+
+  for (l = log_reports; l != NULL; l = g_slist_next(l)) {
+    log_report_t * report = l->data;
+
+    if (report->func == func && report->user_data == user_data) {
+      log_reports = g_slist_delete_link(log_reports, l);
+      g_free(report);
+      return;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+/*
+A log of recent events kept in memory, and only written out
+when someone asks for it.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLET_LOG_H__
+#define __APPLET_LOG_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Adds a description of some state to the end of a dump */
+typedef void (*AppletLogReportFunc) (GString * out, gpointer user_data);
+
+void        applet_log_init          (const gchar * log_name);
+void        applet_log               (const gchar * log_name,
+                                      const gchar * format,
+                                      ...) G_GNUC_PRINTF(2, 3);
+gchar **    applet_log_dump          (void);
+
+void        applet_log_add_report    (const gchar * log_name,
+                                      AppletLogReportFunc func,
+                                      gpointer user_data);
+void        applet_log_remove_report (AppletLogReportFunc func,
+                                      gpointer user_data);
+
+/* Logging from the paths that run for every entry and every
+   change is only built in with --enable-hot-path-log */
+#ifdef ENABLE_HOT_PATH_LOG
+#  define applet_log_hot(...) applet_log(__VA_ARGS__)
+#else
+#  define applet_log_hot(...) G_STMT_START { } G_STMT_END
+#endif
+
+G_END_DECLS
+
+#endif /* __APPLET_LOG_H__ */
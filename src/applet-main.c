@@ -24,6 +24,7 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <config.h>
 #include <glib/gi18n.h>
+#include <gmodule.h>
 #include <panel-applet.h>
 #include <gdk/gdkkeysyms.h>
 
@@ -31,6 +32,11 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <libindicator/indicator-object.h>
 #include <libindicator/indicator-ng.h>
+#include "applet-log.h"
+#include "applet-main.h"
+#include "applet-probes.h"
+#include "applet-trace.h"
+#include "discovery-cache.h"
 #include "tomboykeybinder.h"
 
 static const gchar * indicator_order[][2] = {
@@ -46,183 +52,462 @@ static const gchar * indicator_order[][2] = {
   {NULL, NULL}
 };
 
-static GtkPackDirection packdirection;
-static PanelAppletOrient orient;
+#define  MENU_DATA                   "indicator-menuitem-data"
 
-#define  MENU_DATA_BOX               "box"
-#define  MENU_DATA_INDICATOR_OBJECT  "indicator-object"
-#define  MENU_DATA_INDICATOR_ENTRY   "indicator-entry"
-#define  MENU_DATA_IN_MENUITEM       "in-menuitem"
-#define  MENU_DATA_MENUITEM_PRESSED  "menuitem-pressed"
+#define  MENUBAR_DATA_INDEX          "menubar-index"
+#define  MENUBAR_DATA_UPDATES        "menubar-updates"
+#define  MENUBAR_DATA_VARIANT        "menubar-variant"
+#define  MENUBAR_DATA_ORIENT         "menubar-orient"
+#define  MENUBAR_DATA_INDICATORS     "menubar-indicators"
+#define  MENUBAR_DATA_LOADING        "menubar-loading"
+
+#define  APPLET_DATA_MENUBAR         "indicator-applet-menubar"
 
 #define  IO_DATA_NAME                "indicator-name"
 #define  IO_DATA_ORDER_NUMBER        "indicator-order-number"
 #define  IO_DATA_MENUITEM_LOOKUP     "indicator-menuitem-lookup"
 
-static gboolean applet_fill_cb (PanelApplet * applet, const gchar * iid, gpointer data);
+APPLET_PROBE_DECLARE(module_load);
+APPLET_PROBE_DECLARE(module_loaded);
+APPLET_PROBE_DECLARE(indicator_load);
+APPLET_PROBE_DECLARE(indicator_loaded);
+APPLET_PROBE_DECLARE(entry_added);
+APPLET_PROBE_DECLARE(entry_removed);
+APPLET_PROBE_DECLARE(entry_moved);
+APPLET_PROBE_DECLARE(place_in_menu);
+APPLET_PROBE_DECLARE(hotkey);
+APPLET_PROBE_DECLARE(hotkey_done);
+
+/* The indicator's name for a probe, looked up only while
+   the probe is being traced */
+#define PROBE_IO_NAME(probe, io) \
+  (APPLET_PROBE_ENABLED(probe) ? (const gchar *)g_object_get_data(G_OBJECT(io), IO_DATA_NAME) : NULL)
+
+/* Everything the applet keeps about one of its menuitems.  It is
+   attached once when the menuitem is made and handed to the event
+   handlers as their user data, so they don't look anything up. */
+typedef struct _menuitem_data_t menuitem_data_t;
+struct _menuitem_data_t {
+  GtkWidget * box;
+  IndicatorObject * io;
+  IndicatorObjectEntry * entry;
+  GSequenceIter * index_iter;   /* slot in the menubar's index */
+  gint location;                /* of the entry in its object */
+  guint generation;             /* of the current binding */
+  gboolean in_menuitem;
+  gboolean pressed;
+  gchar * accessible_desc;      /* last name given to ATK */
+  gint64 accessible_time;       /* and when */
+  guint accessible_id;          /* pending accessible update */
+};
+
+static GQuark menuitem_data_quark = 0;
+
+static inline menuitem_data_t *
+menuitem_get_data (GtkWidget * menuitem)
+{
+  return g_object_get_qdata(G_OBJECT(menuitem), menuitem_data_quark);
+}
 
 static void update_accessible_desc (IndicatorObjectEntry * entry, GtkWidget * menuitem);
+static void accessible_desc_set (GtkWidget * menuitem, const gchar * desc);
 
 /*************
- * main
+ * variants
  * ***********/
 
-#ifdef INDICATOR_APPLET
-PANEL_APPLET_IN_PROCESS_FACTORY ("IndicatorAppletFactory",
-               PANEL_TYPE_APPLET,
-               applet_fill_cb, NULL);
-#endif
-#ifdef INDICATOR_APPLET_SESSION
-PANEL_APPLET_IN_PROCESS_FACTORY ("FastUserSwitchAppletFactory",
-               PANEL_TYPE_APPLET,
-               applet_fill_cb, NULL);
-#endif
-#ifdef INDICATOR_APPLET_COMPLETE
-PANEL_APPLET_IN_PROCESS_FACTORY ("IndicatorAppletCompleteFactory",
-               PANEL_TYPE_APPLET,
-               applet_fill_cb, NULL);
-#endif
-#ifdef INDICATOR_APPLET_APPMENU
-PANEL_APPLET_IN_PROCESS_FACTORY ("IndicatorAppletAppmenuFactory",
-               PANEL_TYPE_APPLET,
-               applet_fill_cb, NULL);
-#endif
+/* All of the applets are this same code, they only differ in
+   which indicators they show and how they present themselves.
+   Each factory picks its descriptor by its factory id. */
 
-/*************
- * log files
- * ***********/
-#ifdef INDICATOR_APPLET
-#define LOG_FILE_NAME  "indicator-applet.log"
-#endif
-#ifdef INDICATOR_APPLET_SESSION
-#define LOG_FILE_NAME  "indicator-applet-session.log"
-#endif
-#ifdef INDICATOR_APPLET_COMPLETE
-#define LOG_FILE_NAME  "indicator-applet-complete.log"
-#endif
-#ifdef INDICATOR_APPLET_APPMENU
-#define LOG_FILE_NAME  "indicator-applet-appmenu.log"
-#endif
-static FILE *log_file = NULL;
+/* A sorted set of names, looked up with bsearch() */
+typedef struct _name_set_t name_set_t;
+struct _name_set_t {
+  const gchar * const * names;
+  guint n_names;
+};
+
+#define NAME_SET(array)  { array, G_N_ELEMENTS(array) }
+#define NO_NAMES         { NULL, 0 }
+
+typedef struct _applet_variant_t applet_variant_t;
+struct _applet_variant_t {
+  const gchar * factory_id;
+  const gchar * name;             /* also the accessible name */
+  const gchar * log_name;         /* in the user's cache directory */
+  const gchar * log_domain;       /* for its warnings */
+  const gchar * hotkey;
+  const gchar * environment[3];
+  const gchar * program_name;
+  const gchar * comments;
+  /* Everything is loaded unless the include set is given and
+     doesn't have it, or the exclude set has it */
+  name_set_t include_modules;
+  name_set_t exclude_modules;
+  name_set_t include_services;
+  name_set_t exclude_services;
+  gboolean skip_in_stracciatella;
+};
+
+static const gchar * const appmenu_modules[] = {
+  "libappmenu.so"
+};
+static const gchar * const appmenu_services[] = {
+  "com.canonical.indicator.appmenu"
+};
+static const gchar * const session_modules[] = {
+  "libme.so",
+  "libsession.so"
+};
+static const gchar * const session_services[] = {
+  "com.canonical.indicator.me",
+  "com.canonical.indicator.session"
+};
+static const gchar * const original_excluded_modules[] = {
+  "libappmenu.so",
+  "libdatetime.so",
+  "libme.so",
+  "libsession.so"
+};
+static const gchar * const original_excluded_services[] = {
+  "com.canonical.indicator.appmenu",
+  "com.canonical.indicator.datetime",
+  "com.canonical.indicator.me",
+  "com.canonical.indicator.session"
+};
+
+/* Sorted by factory id */
+static const applet_variant_t applet_variants[] = {
+  {
+    "FastUserSwitchAppletFactory",
+    "indicator-applet-session",
+    "indicator-applet-session.log",
+    "Indicator-Applet-Session",
+    "<Super>S",
+    { "indicator-applet", "indicator-applet-session", NULL },
+    N_("Indicator Applet Session"),
+    N_("A place to adjust your status, change users or exit your session."),
+    NAME_SET(session_modules),
+    NO_NAMES,
+    NAME_SET(session_services),
+    NO_NAMES,
+    TRUE
+  },
+  {
+    "IndicatorAppletAppmenuFactory",
+    "indicator-applet-appmenu",
+    "indicator-applet-appmenu.log",
+    "Indicator-Applet-Appmenu",
+    "<Super>F1",
+    { "indicator-applet", "indicator-applet-appmenu", NULL },
+    N_("Indicator Applet Application Menu"),
+    N_("An applet to hold your application menus."),
+    NAME_SET(appmenu_modules),
+    NO_NAMES,
+    NAME_SET(appmenu_services),
+    NO_NAMES,
+    FALSE
+  },
+  {
+    "IndicatorAppletCompleteFactory",
+    "indicator-applet-complete",
+    "indicator-applet-complete.log",
+    "Indicator-Applet-Complete",
+    "<Super>S",
+    { "indicator-applet", "indicator-applet-complete", NULL },
+    N_("Indicator Applet Complete"),
+    N_("An applet to hold all of the system indicators."),
+    NO_NAMES,
+    NAME_SET(appmenu_modules),
+    NO_NAMES,
+    NAME_SET(appmenu_services),
+    FALSE
+  },
+  {
+    "IndicatorAppletFactory",
+    "indicator-applet",
+    "indicator-applet.log",
+    "Indicator-Applet",
+    "<Super>M",
+    { "indicator-applet", "indicator-applet-original", NULL },
+    N_("Indicator Applet"),
+    N_("An applet to hold all of the system indicators."),
+    NO_NAMES,
+    NAME_SET(original_excluded_modules),
+    NO_NAMES,
+    NAME_SET(original_excluded_services),
+    FALSE
+  }
+};
+
+static int
+compare_name (const void * key, const void * member)
+{
+  return strcmp((const gchar *)key, *(const gchar * const *)member);
+}
+
+static gboolean
+name_set_contains (const name_set_t * set, const gchar * name)
+{
+  return set->names != NULL &&
+         bsearch(name, set->names, set->n_names, sizeof(gchar *), compare_name) != NULL;
+}
+
+static gboolean
+variant_wants (const name_set_t * include, const name_set_t * exclude, const gchar * name)
+{
+  if (include->names != NULL && !name_set_contains(include, name)) {
+    return FALSE;
+  }
+
+  return !name_set_contains(exclude, name);
+}
+
+static const applet_variant_t *
+variant_lookup (const gchar * factory_id)
+{
+  /* factory_id is the first member, so an entry can be
+     compared as a pointer to its name */
+  return bsearch(factory_id, applet_variants, G_N_ELEMENTS(applet_variants),
+                 sizeof(applet_variant_t), compare_name);
+}
+
+static const applet_variant_t *
+menubar_get_variant (GtkWidget * menubar)
+{
+  return g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_VARIANT);
+}
+
+/* The library is shared, so warnings about one of the applets
+   name its own log domain instead of the library's */
+#define menubar_warning(menubar, ...) \
+  g_log(menubar_get_variant(menubar)->log_domain, G_LOG_LEVEL_WARNING, __VA_ARGS__)
+
+/* Labels run along vertical panels, reading towards the middle
+   of the screen */
+static gdouble
+menubar_get_label_angle (GtkWidget * menubar)
+{
+  PanelAppletOrient orient = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_ORIENT));
+
+  switch (gtk_menu_bar_get_pack_direction(GTK_MENU_BAR(menubar))) {
+    case GTK_PACK_DIRECTION_TTB:
+      return (orient == PANEL_APPLET_ORIENT_LEFT) ? 270.0 : 90.0;
+    default:
+      return 0.0;
+  }
+}
 
-/*****************
- * Hotkey support 
- * **************/
-#ifdef INDICATOR_APPLET
-gchar * hotkey_keycode = "<Super>M";
-#endif
-#ifdef INDICATOR_APPLET_SESSION
-gchar * hotkey_keycode = "<Super>S";
-#endif
-#ifdef INDICATOR_APPLET_COMPLETE
-gchar * hotkey_keycode = "<Super>S";
-#endif
-#ifdef INDICATOR_APPLET_APPMENU
-gchar * hotkey_keycode = "<Super>F1";
-#endif
 
 /********************
- * Environment Names
+ * Indicator ordering
+ *
+ * The order can be overridden by an "indicator-applet/order.conf"
+ * key file in the user's or the system's configuration directory:
+ *
+ *   [Indicator Order]
+ *   Order=libappmenu.so;libapplication.so:nm-applet;libmessaging.so;
+ *
+ * where a name can be followed by ':' and an entry's name hint.
+ * Otherwise the built in indicator_order table is used.  Either
+ * way it is turned into a hash table once, so looking up an order
+ * doesn't depend on how many names there are.
  * *******************/
-#ifdef INDICATOR_APPLET
-#define INDICATOR_SPECIFIC_ENV  "indicator-applet-original"
-#endif
-#ifdef INDICATOR_APPLET_SESSION
-#define INDICATOR_SPECIFIC_ENV  "indicator-applet-session"
-#endif
-#ifdef INDICATOR_APPLET_COMPLETE
-#define INDICATOR_SPECIFIC_ENV  "indicator-applet-complete"
-#endif
-#ifdef INDICATOR_APPLET_APPMENU
-#define INDICATOR_SPECIFIC_ENV  "indicator-applet-appmenu"
-#endif
-
-static const gchar * indicator_env[] = {
-  "indicator-applet",
-  INDICATOR_SPECIFIC_ENV,
-  NULL
+#define ORDER_FILE   "indicator-applet" G_DIR_SEPARATOR_S "order.conf"
+#define ORDER_GROUP  "Indicator Order"
+#define ORDER_KEY    "Order"
+
+typedef struct _order_entry_t order_entry_t;
+struct _order_entry_t {
+  gint order;             /* -1 if only the hinted entries are listed */
+  GHashTable * hints;     /* hint -> order */
 };
 
+static GHashTable * order_table = NULL;
+
+static void
+order_entry_free (gpointer data)
+{
+  order_entry_t * entry = (order_entry_t *)data;
+  if (entry->hints != NULL) {
+    g_hash_table_destroy(entry->hints);
+  }
+  g_free(entry);
+}
+
+/* The first place a name is listed wins */
+static void
+order_table_add (const gchar * name, const gchar * hint, gint order)
+{
+  order_entry_t * entry = g_hash_table_lookup(order_table, name);
+
+  if (entry == NULL) {
+    entry = g_new0(order_entry_t, 1);
+    entry->order = -1;
+    g_hash_table_insert(order_table, g_strdup(name), entry);
+  }
+
+  if (hint == NULL) {
+    if (entry->order == -1) {
+      entry->order = order;
+    }
+    return;
+  }
+
+  if (entry->hints == NULL) {
+    entry->hints = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+  if (!g_hash_table_contains(entry->hints, hint)) {
+    g_hash_table_insert(entry->hints, g_strdup(hint), GINT_TO_POINTER(order));
+  }
+}
+
+static gboolean
+order_table_load_file (void)
+{
+  const gchar * dirs[] = { g_get_user_config_dir(), SYSCONFDIR, NULL };
+  GKeyFile * keyfile = g_key_file_new();
+  gchar ** names = NULL;
+  gchar * path = NULL;
+  int i;
+
+  if (g_key_file_load_from_dirs(keyfile, ORDER_FILE, dirs, &path, G_KEY_FILE_NONE, NULL)) {
+    names = g_key_file_get_string_list(keyfile, ORDER_GROUP, ORDER_KEY, NULL, NULL);
+  }
+  g_key_file_free(keyfile);
+
+  if (names == NULL) {
+    g_free(path);
+    return FALSE;
+  }
+
+  applet_log(NULL, "Indicator order from: %s", path);
+
+  for (i = 0; names[i] != NULL; i++) {
+    gchar * hint = strchr(names[i], ':');
+    if (hint != NULL) {
+      *hint++ = '\0';
+    }
+    order_table_add(names[i], hint, i);
+  }
+
+  g_strfreev(names);
+  g_free(path);
+  return TRUE;
+}
+
 static gint
 name2order (const gchar * name, const gchar * hint) {
-  int i;
+  order_entry_t * entry;
 
-  for (i = 0; indicator_order[i][0] != NULL; i++) {
-    if (g_strcmp0(name, indicator_order[i][0]) == 0 &&
-        g_strcmp0(hint, indicator_order[i][1]) == 0) {
-      return i;
+  if (order_table == NULL) {
+    int i;
+
+    order_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, order_entry_free);
+    if (!order_table_load_file()) {
+      for (i = 0; indicator_order[i][0] != NULL; i++) {
+        order_table_add(indicator_order[i][0], indicator_order[i][1], i);
+      }
     }
   }
 
-  return -1;
+  if (name == NULL) {
+    return -1;
+  }
+
+  entry = g_hash_table_lookup(order_table, name);
+  if (entry == NULL) {
+    return -1;
+  }
+
+  if (hint == NULL) {
+    return entry->order;
+  }
+
+  if (entry->hints == NULL || !g_hash_table_contains(entry->hints, hint)) {
+    return -1;
+  }
+
+  return GPOINTER_TO_INT(g_hash_table_lookup(entry->hints, hint));
 }
 
-typedef struct _incoming_position_t incoming_position_t;
-struct _incoming_position_t {
+/* Every menubar keeps its items in a sorted index next to the
+   container, so finding where a new item goes is a search of the
+   index instead of a walk over all the siblings.  The index and
+   the menubar's children are always in the same order.
+
+   An item's slot has the location its entry had when it was
+   placed.  Whenever an object's entries change its slots are
+   renumbered on the next flush of the update queue, so between
+   a change and that flush the numbers can be out of date. */
+typedef struct _menu_slot_t menu_slot_t;
+struct _menu_slot_t {
   gint objposition;
   gint entryposition;
-  gint menupos;
-  gboolean found;
+  guint serial;
 };
 
-/* This function helps by determining where in the menu list
-   this new entry should be placed.  It compares the objects
-   that they're on, and then the individual entries.  Each
-   is progressively more expensive. */
-static void
-place_in_menu_cb (GtkWidget * widget, gpointer user_data)
+static gint
+menu_slot_compare (gconstpointer a, gconstpointer b, gpointer user_data G_GNUC_UNUSED)
 {
-  incoming_position_t * position = (incoming_position_t *)user_data;
-  if (position->found) {
-    /* We've already been placed, just finish the foreach */
-    return;
-  }
+  const menu_slot_t * slota = (const menu_slot_t *)a;
+  const menu_slot_t * slotb = (const menu_slot_t *)b;
 
-  IndicatorObject * io = INDICATOR_OBJECT(g_object_get_data(G_OBJECT(widget), MENU_DATA_INDICATOR_OBJECT));
-  g_return_if_fail(INDICATOR_IS_OBJECT(io));
+  if (slota->objposition != slotb->objposition) {
+    return (slota->objposition < slotb->objposition) ? -1 : 1;
+  }
 
-  gint objposition = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(io), IO_DATA_ORDER_NUMBER));
-  /* We've already passed it, well, then this is where
-     we should be be.  Stop! */
-  if (objposition > position->objposition) {
-    position->found = TRUE;
-    return;
+  if (slota->entryposition != slotb->entryposition) {
+    return (slota->entryposition < slotb->entryposition) ? -1 : 1;
   }
 
-  /* The objects don't match yet, keep looking */
-  if (objposition < position->objposition) {
-    position->menupos++;
-    return;
+  /* Entries of an object are numbered apart once renumbered, so
+     this only settles ties between objects with the same order,
+     the newest one going first */
+  if (slota->serial != slotb->serial) {
+    return (slota->serial > slotb->serial) ? -1 : 1;
   }
 
-  /* The objects are the same, let's start looking at entries. */
-  IndicatorObjectEntry * entry = (IndicatorObjectEntry *)g_object_get_data(G_OBJECT(widget), MENU_DATA_INDICATOR_ENTRY);
-  gint entryposition = indicator_object_get_location(io, entry);
+  return 0;
+}
+
+/* The one place to find the menuitem that shows an entry */
+static GtkWidget *
+lookup_menuitem (IndicatorObject * io, IndicatorObjectEntry * entry)
+{
+  GHashTable * menuitem_lookup = g_object_get_data (G_OBJECT(io), IO_DATA_MENUITEM_LOOKUP);
+  g_return_val_if_fail (menuitem_lookup != NULL, NULL);
 
-  if (entryposition > position->entryposition) {
-    position->found = TRUE;
-    return;
-  }
+  return g_hash_table_lookup (menuitem_lookup, entry);
+}
 
-  if (entryposition < position->entryposition) {
-    position->menupos++;
-    return;
+/* Takes the menuitem out of the index, before it is removed
+   from the menubar. */
+static void
+menu_index_remove (GtkWidget * menuitem)
+{
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  if (data->index_iter != NULL) {
+    g_sequence_remove(data->index_iter);
+    data->index_iter = NULL;
   }
-
-  /* We've got the same object and the same entry.  Well,
-     let's just put it right here then. */
-  position->found = TRUE;
-  return;
 }
 
-/* Position the entry */
+/* Position the entry.  If the caller already knows where the
+   entry is in its object it passes @location, otherwise -1. */
 static void
 place_in_menu (GtkWidget *menubar, 
                GtkWidget *menuitem, 
                IndicatorObject *io, 
-               IndicatorObjectEntry *entry)
+               IndicatorObjectEntry *entry,
+               gint location)
 {
-  incoming_position_t position;
+  static guint serial = 0;
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  GSequence * index;
+  GSequenceIter * iter;
+  menu_slot_t * slot;
+  gint position;
 
   /* Start with the default position for this indicator object */
   gint io_position = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(io), IO_DATA_ORDER_NUMBER));
@@ -231,35 +516,393 @@ place_in_menu (GtkWidget *menubar,
   if (entry->name_hint != NULL) {
     const gchar *name = (const gchar *)g_object_get_data(G_OBJECT(io), IO_DATA_NAME);
     gint entry_position = name2order(name, entry->name_hint);
-    g_debug ("Placing %s (%s): %d", name, entry->name_hint, entry_position);
 
     /* If we don't find the entry, fall back to the indicator object's position */
     if (entry_position > -1)
       io_position = entry_position;
   }
 
-  position.objposition = io_position;
-  position.entryposition = indicator_object_get_location(io, entry);
-  position.menupos = 0;
-  position.found = FALSE;
+  slot = g_new0(menu_slot_t, 1);
+  slot->objposition = io_position;
+  slot->entryposition = (location < 0) ? indicator_object_get_location(io, entry) : location;
+  slot->serial = serial++;
+
+  index = g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_INDEX);
+  iter = g_sequence_insert_sorted(index, slot, menu_slot_compare, NULL);
+  data->index_iter = iter;
+  data->location = slot->entryposition;
+
+  position = g_sequence_iter_get_position(iter);
+
+  APPLET_PROBE(place_in_menu, PROBE_IO_NAME(place_in_menu, io), entry, position);
+  applet_log_hot(menubar_get_variant(menubar)->log_name, "Placing %p from %s at %d", entry,
+                 (const gchar *)g_object_get_data(G_OBJECT(io), IO_DATA_NAME), position);
+
+  gtk_menu_shell_insert(GTK_MENU_SHELL(menubar), menuitem, position);
+}
+
+/* Menuitems whose entries went away are reset and kept for the
+   next entry, up to a limit, and the rest are destroyed.  Every
+   time a menuitem is bound to an entry it gets a new generation,
+   so work queued against an earlier binding can be recognised. */
+#define MENUITEM_POOL_SIZE  16
+
+static GQueue menuitem_pool = G_QUEUE_INIT;
+static guint menuitem_generation = 0;
+
+/* Drops everything the menuitem knows about its entry, so the
+   next entry it is bound to starts from nothing */
+static void
+menuitem_clear_entry (GtkWidget * menuitem)
+{
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+
+  if (data->accessible_id != 0) {
+    g_source_remove(data->accessible_id);
+    data->accessible_id = 0;
+  }
+  accessible_desc_set(menuitem, "");
+  data->accessible_time = 0;
+
+  data->entry = NULL;
+  data->io = NULL;
+  data->in_menuitem = FALSE;
+  data->pressed = FALSE;
+}
+
+/* Takes the entry's widgets back out of the menuitem */
+static void
+menuitem_unbind (GtkWidget * menuitem)
+{
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  GList * children, * child;
+
+  children = gtk_container_get_children(GTK_CONTAINER(data->box));
+  for (child = children; child != NULL; child = g_list_next(child)) {
+    gtk_container_remove(GTK_CONTAINER(data->box), GTK_WIDGET(child->data));
+  }
+  g_list_free(children);
+
+  if (gtk_menu_item_get_submenu(GTK_MENU_ITEM(menuitem)) != NULL) {
+    gtk_menu_item_set_submenu(GTK_MENU_ITEM(menuitem), NULL);
+  }
+
+  menuitem_clear_entry(menuitem);
+}
+
+/* The entry is going away, and may be freed as soon as its
+   removal has been signalled, but the menuitem stays in the
+   menubar until the next flush.  So it is cut loose from the
+   entry and its object's lookup table right away, and the
+   handlers and timeouts find no entry from then on. */
+static void
+menuitem_forget_entry (GtkWidget * menuitem)
+{
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+
+  if (data->io != NULL) {
+    GHashTable * menuitem_lookup = g_object_get_data(G_OBJECT(data->io), IO_DATA_MENUITEM_LOOKUP);
+    if (menuitem_lookup != NULL && g_hash_table_lookup(menuitem_lookup, data->entry) == menuitem) {
+      g_hash_table_remove(menuitem_lookup, data->entry);
+    }
+  }
+
+  menuitem_clear_entry(menuitem);
+}
+
+/* Drops the menuitem of a removed entry from the menubar, then
+   pools or destroys it. */
+static void
+menuitem_release (GtkWidget * menubar, GtkWidget * menuitem)
+{
+  g_object_ref(menuitem);
+  menu_index_remove(menuitem);
+  gtk_container_remove(GTK_CONTAINER(menubar), menuitem);
+
+  menuitem_unbind(menuitem);
+  gtk_widget_hide(menuitem);
+  gtk_widget_set_sensitive(menuitem, TRUE);
+
+  if (menuitem_pool.length < MENUITEM_POOL_SIZE) {
+    /* The pool keeps our reference */
+    g_queue_push_head(&menuitem_pool, menuitem);
+  } else {
+    gtk_widget_destroy(menuitem);
+    g_object_unref(menuitem);
+  }
+}
+
+/* Entry level changes to the menubar are collected per menuitem
+   and applied together on the next frame clock tick.  Only the
+   last requested state counts, and anything that ends up where it
+   started, like a hide followed by a show, is dropped. */
+enum {
+  UPDATE_VISIBLE   = 1 << 0,
+  UPDATE_SENSITIVE = 1 << 1,
+  UPDATE_MOVE      = 1 << 2,
+  UPDATE_RELEASE   = 1 << 3
+};
+
+typedef struct _menu_update_t menu_update_t;
+struct _menu_update_t {
+  guint changes;
+  guint generation;       /* of the binding a release is for */
+  gboolean visible;
+  gboolean sensitive;
+};
+
+typedef struct _update_queue_t update_queue_t;
+struct _update_queue_t {
+  GHashTable * pending;   /* menuitem -> menu_update_t */
+  GHashTable * renumber;  /* objects whose entries changed */
+  guint tick_id;
+  guint queued;
+};
+
+static GHashTable *
+update_queue_pending_new (void)
+{
+  return g_hash_table_new_full(g_direct_hash, g_direct_equal, g_object_unref, g_free);
+}
+
+static update_queue_t *
+update_queue_new (void)
+{
+  update_queue_t * queue = g_new0(update_queue_t, 1);
+  queue->pending = update_queue_pending_new();
+  queue->renumber = g_hash_table_new(g_direct_hash, g_direct_equal);
+  return queue;
+}
+
+static void
+update_queue_free (gpointer data)
+{
+  update_queue_t * queue = (update_queue_t *)data;
+  g_hash_table_destroy(queue->pending);
+  g_hash_table_destroy(queue->renumber);
+  g_free(queue);
+}
+
+/* Brings the slots of the object's menuitems up to date with
+   where its entries are now.  The ones that are out of place, or
+   were asked to move, all come out of the menubar first and are
+   then put back, so each is placed among items that are already
+   where they belong. */
+static guint
+menu_index_renumber (GtkWidget * menubar, IndicatorObject * io, GHashTable * pending)
+{
+  GList * entries = indicator_object_get_entries(io);
+  GPtrArray * moving = g_ptr_array_new();
+  GList * l;
+  gint location = 0;
+  guint i, moved;
+
+  for (l = entries; l != NULL; l = g_list_next(l), location++) {
+    GtkWidget * menuitem = lookup_menuitem(io, (IndicatorObjectEntry *)l->data);
+    menuitem_data_t * data;
+    menu_update_t * update;
+
+    if (menuitem == NULL) {
+      continue;
+    }
+
+    data = menuitem_get_data(menuitem);
+    update = g_hash_table_lookup(pending, menuitem);
+    if (data->index_iter == NULL ||
+        (data->location == location && (update == NULL || !(update->changes & UPDATE_MOVE)))) {
+      continue;
+    }
+
+    data->location = location;
+    g_ptr_array_add(moving, g_object_ref(menuitem));
+  }
+  g_list_free(entries);
+
+  for (i = 0; i < moving->len; i++) {
+    GtkWidget * menuitem = g_ptr_array_index(moving, i);
+    menu_index_remove(menuitem);
+    gtk_container_remove(GTK_CONTAINER(menubar), menuitem);
+  }
+
+  for (i = 0; i < moving->len; i++) {
+    GtkWidget * menuitem = g_ptr_array_index(moving, i);
+    menuitem_data_t * data = menuitem_get_data(menuitem);
+    place_in_menu(menubar, menuitem, data->io, data->entry, data->location);
+    g_object_unref(menuitem);
+  }
+
+  moved = moving->len;
+  g_ptr_array_free(moving, TRUE);
+
+  return moved;
+}
+
+static gboolean
+update_queue_flush (GtkWidget * menubar, GdkFrameClock * clock G_GNUC_UNUSED, gpointer user_data)
+{
+  update_queue_t * queue = (update_queue_t *)user_data;
+  GHashTable * pending = queue->pending;
+  GHashTable * renumber = queue->renumber;
+  GHashTableIter iter;
+  gpointer key, value;
+  guint applied = 0;
+
+  queue->pending = update_queue_pending_new();
+  queue->renumber = g_hash_table_new(g_direct_hash, g_direct_equal);
+  queue->tick_id = 0;
+
+  /* Releases go first, so that the renumbering only sees
+     menuitems that stay */
+  g_hash_table_iter_init(&iter, pending);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    GtkWidget * menuitem = GTK_WIDGET(key);
+    menu_update_t * update = (menu_update_t *)value;
+
+    /* A release only counts if the menuitem wasn't bound to
+       an entry again since it was asked for */
+    if ((update->changes & UPDATE_RELEASE) &&
+        update->generation == menuitem_get_data(menuitem)->generation) {
+      menuitem_release(menubar, menuitem);
+      applied++;
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+
+  g_hash_table_iter_init(&iter, renumber);
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    applied += menu_index_renumber(menubar, INDICATOR_OBJECT(key), pending);
+  }
+
+  g_hash_table_iter_init(&iter, pending);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    GtkWidget * menuitem = GTK_WIDGET(key);
+    menu_update_t * update = (menu_update_t *)value;
+
+    if ((update->changes & UPDATE_VISIBLE) &&
+        update->visible != gtk_widget_get_visible(menuitem)) {
+      gtk_widget_set_visible(menuitem, update->visible);
+      applied++;
+    }
+
+    if ((update->changes & UPDATE_SENSITIVE) &&
+        update->sensitive != gtk_widget_get_sensitive(menuitem)) {
+      gtk_widget_set_sensitive(menuitem, update->sensitive);
+      applied++;
+    }
+  }
+
+  applet_log_hot(menubar_get_variant(menubar)->log_name,
+                 "Menubar updates: %u queued, %u applied", queue->queued, applied);
+  queue->queued = 0;
+
+  g_hash_table_destroy(renumber);
+  g_hash_table_destroy(pending);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Makes sure a flush is scheduled for the menubar */
+static update_queue_t *
+update_queue_schedule (GtkWidget * menubar)
+{
+  update_queue_t * queue = g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_UPDATES);
+
+  queue->queued++;
+  if (queue->tick_id == 0) {
+    queue->tick_id = gtk_widget_add_tick_callback(menubar, update_queue_flush, queue, NULL);
+  }
+
+  return queue;
+}
+
+/* Gets the pending update for a menuitem, making sure a
+   flush is scheduled for it. */
+static menu_update_t *
+update_queue_get (GtkWidget * menuitem)
+{
+  GtkWidget * menubar = gtk_widget_get_parent(menuitem);
+  update_queue_t * queue;
+  menu_update_t * update;
+
+  g_return_val_if_fail(menubar != NULL, NULL);
+  queue = update_queue_schedule(menubar);
+
+  update = g_hash_table_lookup(queue->pending, menuitem);
+  if (update == NULL) {
+    update = g_new0(menu_update_t, 1);
+    g_hash_table_insert(queue->pending, g_object_ref(menuitem), update);
+  }
+
+  return update;
+}
+
+static void
+queue_visible (GtkWidget * menuitem, gboolean visible)
+{
+  menu_update_t * update = update_queue_get(menuitem);
+  g_return_if_fail(update != NULL);
+
+  update->changes |= UPDATE_VISIBLE;
+  update->visible = (visible != FALSE);
+}
+
+static void
+queue_sensitive (GtkWidget * menuitem, gboolean sensitive)
+{
+  menu_update_t * update = update_queue_get(menuitem);
+  g_return_if_fail(update != NULL);
+
+  update->changes |= UPDATE_SENSITIVE;
+  update->sensitive = (sensitive != FALSE);
+}
+
+/* The entries of the object were added, removed or moved, so
+   all of its menuitems get checked against where they are now */
+static void
+queue_renumber (GtkWidget * menubar, IndicatorObject * io)
+{
+  update_queue_t * queue = update_queue_schedule(menubar);
+  g_hash_table_add(queue->renumber, io);
+}
+
+/* Places the menuitem again even if its entry's location
+   stays the same, as it does when it was bound to a new entry */
+static void
+queue_move (GtkWidget * menuitem, IndicatorObject * io)
+{
+  menu_update_t * update = update_queue_get(menuitem);
+  g_return_if_fail(update != NULL);
+
+  update->changes |= UPDATE_MOVE;
+  queue_renumber(gtk_widget_get_parent(menuitem), io);
+}
+
+/* The menuitem can be given back once the frame comes */
+static void
+queue_release (GtkWidget * menuitem)
+{
+  menu_update_t * update = update_queue_get(menuitem);
+  g_return_if_fail(update != NULL);
 
-  gtk_container_foreach(GTK_CONTAINER(menubar), place_in_menu_cb, &position);
+  update->changes &= ~UPDATE_MOVE;
 
-  gtk_menu_shell_insert(GTK_MENU_SHELL(menubar), menuitem, position.menupos);
+  update->changes |= UPDATE_VISIBLE | UPDATE_RELEASE;
+  update->visible = FALSE;
+  update->generation = menuitem_get_data(menuitem)->generation;
 }
 
 static void
 something_shown (GtkWidget * widget, gpointer user_data)
 {
   GtkWidget * menuitem = GTK_WIDGET(user_data);
-  gtk_widget_show(menuitem);
+  queue_visible(menuitem, TRUE);
 }
 
 static void
 something_hidden (GtkWidget * widget, gpointer user_data)
 {
   GtkWidget * menuitem = GTK_WIDGET(user_data);
-  gtk_widget_hide(menuitem);
+  queue_visible(menuitem, FALSE);
 }
 
 static void
@@ -268,177 +911,251 @@ sensitive_cb (GObject * obj, GParamSpec * pspec, gpointer user_data)
   g_return_if_fail(GTK_IS_WIDGET(obj));
   g_return_if_fail(GTK_IS_WIDGET(user_data));
 
-  gtk_widget_set_sensitive(GTK_WIDGET(user_data), gtk_widget_get_sensitive(GTK_WIDGET(obj)));
+  queue_sensitive(GTK_WIDGET(user_data), gtk_widget_get_sensitive(GTK_WIDGET(obj)));
   return;
 }
 
 static void
 entry_activated (GtkWidget * widget, gpointer user_data)
 {
-  g_return_if_fail(GTK_IS_WIDGET(widget));
+  menuitem_data_t * data = (menuitem_data_t *)user_data;
 
-  IndicatorObject *io = g_object_get_data (G_OBJECT (widget), MENU_DATA_INDICATOR_OBJECT);
-  IndicatorObjectEntry *entry = g_object_get_data (G_OBJECT (widget), MENU_DATA_INDICATOR_ENTRY);
+  /* Its entry was removed */
+  if (data->entry == NULL) {
+    return;
+  }
 
-  g_return_if_fail(INDICATOR_IS_OBJECT(io));
+  g_return_if_fail(INDICATOR_IS_OBJECT(data->io));
 
-  return indicator_object_entry_activate(io, entry, gtk_get_current_event_time());
+  return indicator_object_entry_activate(data->io, data->entry, gtk_get_current_event_time());
 }
 
 static gboolean
 entry_secondary_activated (GtkWidget * widget, GdkEvent * event, gpointer user_data)
 {
-  g_return_val_if_fail(GTK_IS_WIDGET(widget), FALSE);
+  menuitem_data_t * data = (menuitem_data_t *)user_data;
+
+  if (data->entry == NULL) {
+    return FALSE;
+  }
 
   switch (event->type) {
     case GDK_ENTER_NOTIFY:
-      g_object_set_data(G_OBJECT(widget), MENU_DATA_IN_MENUITEM, GINT_TO_POINTER(TRUE));
+      data->in_menuitem = TRUE;
       break;
 
     case GDK_LEAVE_NOTIFY:
-      g_object_set_data(G_OBJECT(widget), MENU_DATA_IN_MENUITEM, GINT_TO_POINTER(FALSE));
-      g_object_set_data(G_OBJECT(widget), MENU_DATA_MENUITEM_PRESSED, GINT_TO_POINTER(FALSE));
+      data->in_menuitem = FALSE;
+      data->pressed = FALSE;
       break;
 
     case GDK_BUTTON_PRESS:
       if (event->button.button == 2) {
-        g_object_set_data(G_OBJECT(widget), MENU_DATA_MENUITEM_PRESSED, GINT_TO_POINTER(TRUE));
+        data->pressed = TRUE;
       }
       break;
 
     case GDK_BUTTON_RELEASE:
       if (event->button.button == 2) {
-        gboolean in_menuitem = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), MENU_DATA_IN_MENUITEM));
-        gboolean menuitem_pressed = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), MENU_DATA_MENUITEM_PRESSED));
-
-        if (in_menuitem && menuitem_pressed) {
-          g_object_set_data(G_OBJECT(widget), MENU_DATA_MENUITEM_PRESSED, GINT_TO_POINTER(FALSE));
-
-          IndicatorObject *io = g_object_get_data(G_OBJECT(widget), MENU_DATA_INDICATOR_OBJECT);
-          IndicatorObjectEntry *entry = g_object_get_data(G_OBJECT(widget), MENU_DATA_INDICATOR_ENTRY);
+        if (data->in_menuitem && data->pressed) {
+          data->pressed = FALSE;
 
-          g_return_val_if_fail(INDICATOR_IS_OBJECT(io), FALSE);
+          g_return_val_if_fail(INDICATOR_IS_OBJECT(data->io), FALSE);
 
-          g_signal_emit_by_name(io, INDICATOR_OBJECT_SIGNAL_SECONDARY_ACTIVATE, 
-              entry, event->button.time);
+          g_signal_emit_by_name(data->io, INDICATOR_OBJECT_SIGNAL_SECONDARY_ACTIVATE, 
+              data->entry, event->button.time);
         }
       }
       break;
+
+    default:
+      break;
   }
 
   return FALSE;
 }
 
 static gboolean
-entry_scrolled (GtkWidget *menuitem, GdkEventScroll *event, gpointer data)
+entry_scrolled (GtkWidget *menuitem, GdkEventScroll *event, gpointer user_data)
 {
-  g_return_val_if_fail(GTK_IS_WIDGET(menuitem), FALSE);
+  menuitem_data_t * data = (menuitem_data_t *)user_data;
 
-  IndicatorObject *io = g_object_get_data (G_OBJECT (menuitem), MENU_DATA_INDICATOR_OBJECT);
-  IndicatorObjectEntry *entry = g_object_get_data (G_OBJECT (menuitem), MENU_DATA_INDICATOR_ENTRY);
+  if (data->entry == NULL) {
+    return FALSE;
+  }
 
-  g_return_val_if_fail(INDICATOR_IS_OBJECT(io), FALSE);
+  g_return_val_if_fail(INDICATOR_IS_OBJECT(data->io), FALSE);
 
-  g_signal_emit_by_name (io, INDICATOR_OBJECT_SIGNAL_ENTRY_SCROLLED, entry, 1, event->direction);
+  g_signal_emit_by_name (data->io, INDICATOR_OBJECT_SIGNAL_ENTRY_SCROLLED, data->entry, 1, event->direction);
 
   return FALSE;
 }
 
 static void
-accessible_desc_update_cb (GtkWidget * widget, gpointer userdata)
+accessible_desc_update (IndicatorObject * io, IndicatorObjectEntry * entry, GtkWidget * menubar)
 {
-  gpointer data = g_object_get_data(G_OBJECT(widget), MENU_DATA_INDICATOR_ENTRY);
-
-  if (data != userdata) {
+  GtkWidget * menuitem = lookup_menuitem(io, entry);
+  if (menuitem == NULL) {
     return;
   }
 
-  IndicatorObjectEntry * entry = (IndicatorObjectEntry *)data;
-  update_accessible_desc(entry, widget);
+  update_accessible_desc(entry, menuitem);
+  return;
 }
 
 static void
-accessible_desc_update (IndicatorObject * io, IndicatorObjectEntry * entry, GtkWidget * menubar)
+menuitem_data_free (gpointer user_data)
 {
-  gtk_container_foreach(GTK_CONTAINER(menubar), accessible_desc_update_cb, entry);
-  return;
+  menuitem_data_t * data = (menuitem_data_t *)user_data;
+
+  if (data->accessible_id != 0) {
+    g_source_remove(data->accessible_id);
+  }
+
+  g_free(data->accessible_desc);
+  g_free(data);
 }
 
-static GtkWidget*
-create_menuitem (IndicatorObject * io, IndicatorObjectEntry * entry, GtkWidget * menubar)
+static GtkWidget *
+menuitem_new (void)
 {
-  GtkWidget * box;
+  menuitem_data_t * data;
   GtkWidget * menuitem;
 
+  if (menuitem_data_quark == 0) {
+    menuitem_data_quark = g_quark_from_static_string(MENU_DATA);
+  }
+
   menuitem = gtk_menu_item_new();
-  box = (packdirection == GTK_PACK_DIRECTION_LTR)
-      ? gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 3)
-      : gtk_box_new (GTK_ORIENTATION_VERTICAL, 3);
+
+  data = g_new0(menuitem_data_t, 1);
+  /* Oriented when it gets bound */
+  data->box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 3);
+  g_object_set_qdata_full(G_OBJECT(menuitem), menuitem_data_quark, data, menuitem_data_free);
 
   gtk_widget_add_events(GTK_WIDGET(menuitem), GDK_SCROLL_MASK);
 
-  g_object_set_data (G_OBJECT (menuitem), MENU_DATA_BOX, box);
-  g_object_set_data(G_OBJECT(menuitem), MENU_DATA_INDICATOR_ENTRY,  entry);
-  g_object_set_data(G_OBJECT(menuitem), MENU_DATA_INDICATOR_OBJECT, io);
+  g_signal_connect(G_OBJECT(menuitem), "activate", G_CALLBACK(entry_activated), data);
+  g_signal_connect(G_OBJECT(menuitem), "button-press-event", G_CALLBACK(entry_secondary_activated), data);
+  g_signal_connect(G_OBJECT(menuitem), "button-release-event", G_CALLBACK(entry_secondary_activated), data);
+  g_signal_connect(G_OBJECT(menuitem), "enter-notify-event", G_CALLBACK(entry_secondary_activated), data);
+  g_signal_connect(G_OBJECT(menuitem), "leave-notify-event", G_CALLBACK(entry_secondary_activated), data);
+  g_signal_connect(G_OBJECT(menuitem), "scroll-event", G_CALLBACK(entry_scrolled), data);
+
+  gtk_container_add(GTK_CONTAINER(menuitem), data->box);
+  gtk_widget_show(data->box);
+
+  return menuitem;
+}
+
+/* gtk_box_pack requires that the widget has no parent, and the
+   menuitem of a removed entry may still hold it until the flush */
+static void
+menuitem_pack (GtkWidget * box, GtkWidget * widget)
+{
+  GtkWidget * parent = gtk_widget_get_parent(widget);
+
+  g_object_ref(widget);
+  if (parent != NULL) {
+    gtk_container_remove(GTK_CONTAINER(parent), widget);
+  }
+  gtk_box_pack_start(GTK_BOX(box), widget, FALSE, FALSE, 1);
+  g_object_unref(widget);
+}
+
+/* Puts the entry's widgets into a new or recycled menuitem */
+static void
+menuitem_bind (GtkWidget * menuitem, IndicatorObject * io, IndicatorObjectEntry * entry,
+               GtkWidget * menubar)
+{
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  GtkWidget * box = data->box;
+
+  gtk_orientable_set_orientation(GTK_ORIENTABLE(box),
+      (gtk_menu_bar_get_pack_direction(GTK_MENU_BAR(menubar)) == GTK_PACK_DIRECTION_LTR) ?
+      GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL);
 
-  g_signal_connect(G_OBJECT(menuitem), "activate", G_CALLBACK(entry_activated), NULL);
-  g_signal_connect(G_OBJECT(menuitem), "button-press-event", G_CALLBACK(entry_secondary_activated), NULL);
-  g_signal_connect(G_OBJECT(menuitem), "button-release-event", G_CALLBACK(entry_secondary_activated), NULL);
-  g_signal_connect(G_OBJECT(menuitem), "enter-notify-event", G_CALLBACK(entry_secondary_activated), NULL);
-  g_signal_connect(G_OBJECT(menuitem), "leave-notify-event", G_CALLBACK(entry_secondary_activated), NULL);
-  g_signal_connect(G_OBJECT(menuitem), "scroll-event", G_CALLBACK(entry_scrolled), NULL);
+  data->entry = entry;
+  data->io = io;
+  data->generation = ++menuitem_generation;
 
   if (entry->image != NULL) {
-    gtk_box_pack_start(GTK_BOX(box), GTK_WIDGET(entry->image), FALSE, FALSE, 1);
+    menuitem_pack(box, GTK_WIDGET(entry->image));
   }
   if (entry->label != NULL) {
-    switch(packdirection) {
-      case GTK_PACK_DIRECTION_LTR:
-        gtk_label_set_angle(GTK_LABEL(entry->label), 0.0);
-        break;
-      case GTK_PACK_DIRECTION_TTB:
-        gtk_label_set_angle(GTK_LABEL(entry->label),
-            (orient == PANEL_APPLET_ORIENT_LEFT) ? 
-            270.0 : 90.0);
-        break;
-      default:
-        break;
-    }
-    /* gtk_box_pack requires that the widget has no parent */
-    gtk_widget_unparent(GTK_WIDGET(entry->label));
-    gtk_box_pack_start(GTK_BOX(box), GTK_WIDGET(entry->label), FALSE, FALSE, 1);
+    gtk_label_set_angle(GTK_LABEL(entry->label), menubar_get_label_angle(menubar));
+    menuitem_pack(box, GTK_WIDGET(entry->label));
   }
-  gtk_container_add(GTK_CONTAINER(menuitem), box);
-  gtk_widget_show(box);
 
   if (entry->menu != NULL) {
     gtk_menu_item_set_submenu(GTK_MENU_ITEM(menuitem), GTK_WIDGET(entry->menu));
   }
+}
+
+/* Binds the menuitem again, holding on to the entry's widgets
+   while they are out of the box. */
+static void
+menuitem_rebind (GtkWidget * menuitem, IndicatorObject * io, IndicatorObjectEntry * entry,
+                 GtkWidget * menubar)
+{
+  GObject * image = G_IS_OBJECT(entry->image) ? g_object_ref(entry->image) : NULL;
+  GObject * label = G_IS_OBJECT(entry->label) ? g_object_ref(entry->label) : NULL;
+  GObject * menu = G_IS_OBJECT(entry->menu) ? g_object_ref(entry->menu) : NULL;
+
+  menuitem_unbind(menuitem);
+  menuitem_bind(menuitem, io, entry, menubar);
+
+  if (image != NULL) g_object_unref(image);
+  if (label != NULL) g_object_unref(label);
+  if (menu != NULL) g_object_unref(menu);
+}
 
-  place_in_menu(menubar, menuitem, io, entry);
+static GtkWidget*
+create_menuitem (IndicatorObject * io, IndicatorObjectEntry * entry, gint location, GtkWidget * menubar)
+{
+  GtkWidget * menuitem = g_queue_pop_head(&menuitem_pool);
+  gboolean recycled = (menuitem != NULL);
+
+  if (!recycled) {
+    menuitem = menuitem_new();
+  }
+
+  menuitem_bind(menuitem, io, entry, menubar);
+  place_in_menu(menubar, menuitem, io, entry, location);
+
+  if (recycled) {
+    /* The menubar holds it now */
+    g_object_unref(menuitem);
+  }
 
   return menuitem;
 }
 
 static void
-entry_added (IndicatorObject * io, IndicatorObjectEntry * entry, GtkWidget * menubar)
+add_entry (IndicatorObject * io, IndicatorObjectEntry * entry, gint location, GtkWidget * menubar)
 {
-  const gchar * name;
   GtkWidget * menuitem;
   GHashTable * menuitem_lookup;
   gboolean something_visible;
   gboolean something_sensitive;
 
-  name = g_object_get_data (G_OBJECT(io), IO_DATA_NAME);
-  g_debug ("Signal: Entry Added from %s", name);
+  APPLET_PROBE (entry_added, PROBE_IO_NAME (entry_added, io), entry, location);
+  applet_log_hot (menubar_get_variant (menubar)->log_name, "Signal: Entry Added from %s",
+                  (const gchar *) g_object_get_data (G_OBJECT(io), IO_DATA_NAME));
 
   /* if the menuitem doesn't already exist, create it now */
   menuitem_lookup = g_object_get_data (G_OBJECT(io), IO_DATA_MENUITEM_LOOKUP);
   g_return_if_fail (menuitem_lookup != NULL);
   menuitem = g_hash_table_lookup (menuitem_lookup, entry);
   if (menuitem == NULL) {
-    menuitem = create_menuitem (io, entry, menubar);
+    menuitem = create_menuitem (io, entry, location, menubar);
     g_hash_table_insert (menuitem_lookup, entry, menuitem);
+    /* The entries after it have new locations */
+    queue_renumber (menubar, io);
+  } else {
+    /* Added twice without being removed in between */
+    menuitem_rebind (menuitem, io, entry, menubar);
+    queue_move (menuitem, io);
   }
 
   /* connect the callbacks */
@@ -474,26 +1191,32 @@ entry_added (IndicatorObject * io, IndicatorObjectEntry * entry, GtkWidget * men
     if (entry->accessible_desc != NULL) {
       update_accessible_desc(entry, menuitem);
     }
-    gtk_widget_show(menuitem);
+    queue_visible(menuitem, TRUE);
   }
-  gtk_widget_set_sensitive(menuitem, something_sensitive);
+  queue_sensitive(menuitem, something_sensitive);
 
   return;
 }
 
+static void
+entry_added (IndicatorObject * io, IndicatorObjectEntry * entry, GtkWidget * menubar)
+{
+  add_entry(io, entry, -1, menubar);
+}
+
 static void
 entry_removed (IndicatorObject * io,
                IndicatorObjectEntry * entry,
                gpointer user_data)
 {
   GtkWidget * menuitem;
-  GHashTable * menuitem_lookup;
 
-  g_debug("Signal: Entry Removed");
+  APPLET_PROBE (entry_removed, PROBE_IO_NAME (entry_removed, io), entry);
+  applet_log_hot (menubar_get_variant (GTK_WIDGET (user_data))->log_name,
+                  "Signal: Entry Removed from %s",
+                  (const gchar *) g_object_get_data (G_OBJECT(io), IO_DATA_NAME));
 
-  menuitem_lookup = g_object_get_data (G_OBJECT(io), IO_DATA_MENUITEM_LOOKUP);
-  g_return_if_fail (menuitem_lookup != NULL);
-  menuitem = g_hash_table_lookup (menuitem_lookup, entry);
+  menuitem = lookup_menuitem (io, entry);
   g_return_if_fail (menuitem != NULL);
 
   /* disconnect the callbacks */
@@ -512,273 +1235,594 @@ entry_removed (IndicatorObject * io,
                          NULL);
   }
 
-  gtk_widget_hide (menuitem);
+  menuitem_forget_entry (menuitem);
+  queue_release (menuitem);
+  queue_renumber (GTK_WIDGET (user_data), io);
 
   return;
 }
 
+/* Gets called when an entry for an object was moved. */
 static void
-entry_moved_find_cb (GtkWidget * widget, gpointer userdata)
+entry_moved (IndicatorObject * io, IndicatorObjectEntry * entry,
+             gint old, gint new, gpointer user_data)
 {
-  gpointer * array = (gpointer *)userdata;
-  if (array[1] != NULL) {
-    return;
-  }
+  GtkWidget * mi = lookup_menuitem(io, entry);
 
-  gpointer data = g_object_get_data(G_OBJECT(widget), MENU_DATA_INDICATOR_ENTRY);
+  APPLET_PROBE(entry_moved, PROBE_IO_NAME(entry_moved, io), entry, old, new);
+  applet_log_hot(menubar_get_variant(GTK_WIDGET(user_data))->log_name,
+                 "Signal: Entry Moved from %s to %d", (const gchar *)g_object_get_data(G_OBJECT(io), IO_DATA_NAME), new);
 
-  if (data != array[0]) {
+  if (mi == NULL) {
+    menubar_warning(GTK_WIDGET(user_data), "Moving an entry that isn't in our menus.");
     return;
   }
 
-  array[1] = widget;
+  /* The entries between the old and the new location shifted
+     too, so all of the object's menuitems are checked */
+  queue_renumber(GTK_WIDGET(user_data), io);
+
   return;
 }
 
-/* Gets called when an entry for an object was moved. */
 static void
-entry_moved (IndicatorObject * io, IndicatorObjectEntry * entry,
-             gint old G_GNUC_UNUSED, gint new G_GNUC_UNUSED, gpointer user_data)
+menu_show (IndicatorObject * io, IndicatorObjectEntry * entry,
+           guint32 timestamp, gpointer user_data)
 {
   GtkWidget * menubar = GTK_WIDGET(user_data);
 
-  gpointer array[2];
-  array[0] = entry;
-  array[1] = NULL;
+  if (entry == NULL) {
+    /* Close any open menus instead of opening one */
+    GList * l;
+    GList * entries = indicator_object_get_entries(io);
+    for (l = entries; l != NULL; l = g_list_next(entry)) {
+      IndicatorObjectEntry * entrydata = l->data;
+      gtk_menu_popdown(entrydata->menu);
+    }
+    g_list_free(entries);
+
+    /* And tell the menubar to exit activation mode too */
+    gtk_menu_shell_cancel(GTK_MENU_SHELL(menubar));
+    return;
+  }
+
+  // TODO: do something sensible here
+}
+
+/* Every new accessible name goes out over the accessibility bus
+   to each client, and some indicators change their description
+   all the time.  So a name that hasn't changed isn't set again,
+   and a menuitem gets at most one new name per interval: the
+   first straight away and then the latest when the interval ends. */
+#define ACCESSIBLE_DESC_INTERVAL  250   /* ms */
+
+static void
+accessible_desc_set (GtkWidget * menuitem, const gchar * desc)
+{
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  AtkObject * menuitem_obj;
+
+  if (g_strcmp0(data->accessible_desc, desc) == 0) {
+    return;
+  }
+
+  menuitem_obj = gtk_widget_get_accessible(menuitem);
+  if (menuitem_obj == NULL) {
+    /* Should there be an error printed here? */
+    return;
+  }
+
+  g_free(data->accessible_desc);
+  data->accessible_desc = g_strdup(desc);
+  data->accessible_time = g_get_monotonic_time();
+  atk_object_set_name(menuitem_obj, desc);
+}
+
+static gboolean
+accessible_desc_timeout (gpointer user_data)
+{
+  GtkWidget * menuitem = GTK_WIDGET(user_data);
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+
+  data->accessible_id = 0;
+  if (data->entry != NULL) {
+    accessible_desc_set(menuitem, data->entry->accessible_desc != NULL ?
+                                  data->entry->accessible_desc : "");
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+update_accessible_desc(IndicatorObjectEntry * entry, GtkWidget * menuitem)
+{
+  /* FIXME: We need to deal with the use case where the contents of the
+     label overrides what is found in the atk object's name, or at least
+     orca speaks the label instead of the atk object name.
+   */
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  const gchar * desc = entry->accessible_desc != NULL ? entry->accessible_desc : "";
+  gint64 wait;
+
+  /* One is already due, and it reads the entry when it goes */
+  if (data->accessible_id != 0) {
+    return;
+  }
 
-  gtk_container_foreach(GTK_CONTAINER(menubar), entry_moved_find_cb, array);
-  if (array[1] == NULL) {
-    g_warning("Moving an entry that isn't in our menus.");
+  if (g_strcmp0(data->accessible_desc, desc) == 0) {
     return;
   }
 
-  GtkWidget * mi = GTK_WIDGET(array[1]);
-  g_object_ref(G_OBJECT(mi));
-  gtk_container_remove(GTK_CONTAINER(menubar), mi);
-  place_in_menu(menubar, mi, io, entry);
-  g_object_unref(G_OBJECT(mi));
+  wait = data->accessible_time + ACCESSIBLE_DESC_INTERVAL * 1000 - g_get_monotonic_time();
+  if (data->accessible_time == 0 || wait <= 0) {
+    accessible_desc_set(menuitem, desc);
+  } else {
+    data->accessible_id = g_timeout_add(wait / 1000 + 1, accessible_desc_timeout, menuitem);
+  }
+}
+
+static void load_indicator(GtkWidget * menubar, IndicatorObject *object, const gchar *name) {
+	GObject * o;
+	GList *entries, *entry;
+	gint64 span = applet_trace_begin();
+
+	APPLET_PROBE(indicator_load, name, object);
+
+	/* Set the environment it's in */
+	indicator_object_set_environment(object, (GStrv)menubar_get_variant(menubar)->environment);
+
+	/* Attach the 'name' to the object */
+	o = G_OBJECT (object);
+	g_object_set_data_full(o, IO_DATA_MENUITEM_LOOKUP, g_hash_table_new (g_direct_hash, g_direct_equal), (GDestroyNotify)g_hash_table_destroy);
+	g_object_set_data_full(o, IO_DATA_NAME, g_strdup(name), g_free);
+	
+	int pos = 5000 - indicator_object_get_position(object);
+	if (pos > 5000) {
+	    pos = name2order(name, NULL);
+	}
+	
+	g_object_set_data(o, IO_DATA_ORDER_NUMBER, GINT_TO_POINTER(pos));
+	g_ptr_array_add(g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_INDICATORS), g_object_ref(o));
+
+	/* Connect to its signals */
+	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED,   G_CALLBACK(entry_added),    menubar);
+	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ENTRY_REMOVED, G_CALLBACK(entry_removed),  menubar);
+	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ENTRY_MOVED,   G_CALLBACK(entry_moved),    menubar);
+	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_MENU_SHOW,     G_CALLBACK(menu_show),      menubar);
+	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ACCESSIBLE_DESC_UPDATE, G_CALLBACK(accessible_desc_update), menubar);
+
+	/* Work on the entries, the list is in location order so
+	   there's no need to look each one up again */
+	entries = indicator_object_get_entries(object);
+
+	gint location = 0;
+	for (entry = entries; entry != NULL; entry = g_list_next(entry)) {
+		IndicatorObjectEntry * entrydata = (IndicatorObjectEntry *) entry->data;
+		add_entry(object, entrydata, location++, menubar);
+	}
+
+	g_list_free(entries);
+
+	APPLET_PROBE(indicator_loaded, name, object, location);
+	applet_trace_end(span, "load_indicator", name);
+}
+
+/*************
+ * background loading
+ *
+ * Opening a module runs its library constructors and resolves
+ * its symbols, and parsing a service file hits the disk, both of
+ * which can take a while.  So that work is done on a worker thread
+ * and the result is handed back through a queue to the main loop,
+ * which builds the object.
+ *
+ * Both the workers and the main loop take the jobs in the order
+ * their indicators had in the menubar last time, as remembered by
+ * the discovery cache, so the panel fills in from one end instead
+ * of every new indicator landing between ones already there.
+ * ***********/
+typedef struct _load_job_t load_job_t;
+struct _load_job_t {
+  void (*run) (load_job_t * job);      /* on a worker thread */
+  void (*finish) (load_job_t * job);   /* in the main loop */
+  gchar * name;
+  GtkWidget * menubar;
+  GModule * module;
+  DiscoveryCache * cache;
+  gint order;                          /* from the last time */
+  gchar * error;
+};
+
+static GThreadPool * loader_pool = NULL;
+static GAsyncQueue * loader_queue = NULL;
+static guint loader_pending = 0;        /* jobs not finished yet */
+static GMutex loader_lock;              /* for the idle source */
+static guint loader_idle_id = 0;
+
+/* The startup timeline ends once a menubar has been drawn and
+   every indicator has been tried, whichever comes last, so the
+   loading that runs after the first paint is in it */
+static gboolean trace_drawn = FALSE;
+
+static void
+trace_startup_progress (void)
+{
+  if (trace_drawn && loader_pending == 0) {
+    applet_trace_finish();
+  } else {
+    applet_trace_write();
+  }
+}
+
+/* Where the indicators are found.  The environment can point
+   elsewhere so load tests don't need any installed. */
+static const gchar *
+indicator_module_dir (void)
+{
+  const gchar * dir = g_getenv("INDICATOR_APPLET_MODULE_DIR");
+  return (dir != NULL && dir[0] != '\0') ? dir : INDICATOR_DIR;
+}
+
+#define INDICATOR_SERVICE_DIR "/usr/share/unity/indicators"
+
+static const gchar *
+indicator_service_dir (void)
+{
+  const gchar * dir = g_getenv("INDICATOR_APPLET_SERVICE_DIR");
+  return (dir != NULL && dir[0] != '\0') ? dir : INDICATOR_SERVICE_DIR;
+}
+
+/* A label to allow for click through */
+static void
+applet_show_no_indicators (GtkWidget * applet)
+{
+  GtkWidget * item = gtk_label_new(_("No Indicators"));
+  gtk_container_add(GTK_CONTAINER(applet), item);
+  gtk_widget_show(item);
+}
+
+/* Once every indicator for the menubar has been tried, one that
+   didn't get any gives its place in the applet to the label */
+static void
+menubar_job_done (GtkWidget * menubar)
+{
+  gint loading = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_LOADING)) - 1;
+  GPtrArray * indicators = g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_INDICATORS);
+  GtkWidget * applet = gtk_widget_get_parent(menubar);
+
+  g_object_set_data(G_OBJECT(menubar), MENUBAR_DATA_LOADING, GINT_TO_POINTER(loading));
+  if (loading > 0 || indicators->len > 0 || !PANEL_IS_APPLET(applet)) {
+    return;
+  }
+
+  applet_log(menubar_get_variant(menubar)->log_name, "No indicators could be loaded");
+
+  /* The hotkey still points at the menubar, so the applet keeps it */
+  g_object_set_data_full(G_OBJECT(applet), APPLET_DATA_MENUBAR,
+                         g_object_ref(menubar), g_object_unref);
+  gtk_container_remove(GTK_CONTAINER(applet), menubar);
+  applet_show_no_indicators(applet);
+}
+
+static void
+load_job_free (load_job_t * job)
+{
+  if (job->module != NULL) {
+    g_module_close(job->module);
+  }
+  if (job->cache != NULL) {
+    discovery_cache_unref(job->cache);
+  }
+  menubar_job_done(job->menubar);
+  g_object_unref(job->menubar);
+  g_free(job->error);
+  g_free(job->name);
+  g_free(job);
+
+  if (--loader_pending == 0) {
+    applet_log(NULL, "All indicators loaded");
+    applet_trace_instant("all indicators loaded", NULL);
+    trace_startup_progress();
+  }
+}
+
+/* Runs in the main loop below the redraw priority and finishes
+   one job per pass, so the panel gets painted between indicators
+   and a slow constructor doesn't hold up the ones behind it.
+   There is only ever one of these sources, and it stays while
+   the queue has jobs in it. */
+static gboolean
+loader_queue_drain (gpointer user_data G_GNUC_UNUSED)
+{
+  load_job_t * job = g_async_queue_try_pop(loader_queue);
+
+  if (job != NULL) {
+    job->finish(job);
+    load_job_free(job);
+  }
+
+  /* The workers push under the lock, so a job can't arrive
+     between looking at the queue and dropping the source */
+  g_mutex_lock(&loader_lock);
+  if (g_async_queue_length(loader_queue) > 0) {
+    g_mutex_unlock(&loader_lock);
+    return TRUE;
+  }
+  loader_idle_id = 0;
+  g_mutex_unlock(&loader_lock);
+
+  return FALSE;
+}
+
+/* Finishes everything that is ready right away, for when the
+   user reaches for the panel before the idle loading is done. */
+static void
+loader_flush (void)
+{
+  load_job_t * job;
+
+  if (loader_queue == NULL) {
+    return;
+  }
+
+  while ((job = g_async_queue_try_pop(loader_queue)) != NULL) {
+    job->finish(job);
+    load_job_free(job);
+  }
+}
+
+static gint
+load_job_compare (gconstpointer a, gconstpointer b, gpointer user_data G_GNUC_UNUSED)
+{
+  const load_job_t * joba = (const load_job_t *)a;
+  const load_job_t * jobb = (const load_job_t *)b;
+
+  if (joba->order != jobb->order) {
+    return (joba->order < jobb->order) ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static void
+loader_thread (gpointer data, gpointer user_data G_GNUC_UNUSED)
+{
+  load_job_t * job = (load_job_t *)data;
+
+  job->run(job);
+
+  g_mutex_lock(&loader_lock);
+  g_async_queue_push_sorted(loader_queue, job, load_job_compare, NULL);
+  if (loader_idle_id == 0) {
+    loader_idle_id = g_idle_add_full(G_PRIORITY_LOW, loader_queue_drain, NULL, NULL);
+  }
+  g_mutex_unlock(&loader_lock);
+}
+
+static void
+loader_push (load_job_t * job, const gchar * name, GtkWidget * menubar)
+{
+  if (loader_pool == NULL) {
+    loader_queue = g_async_queue_new();
+    loader_pool = g_thread_pool_new(loader_thread, NULL,
+                                    g_get_num_processors(), FALSE, NULL);
+    g_thread_pool_set_sort_function(loader_pool, load_job_compare, NULL);
+  }
+
+  job->name = g_strdup(name);
+  job->order = discovery_cache_get_order(job->cache, name);
+  job->menubar = g_object_ref(menubar);
+  loader_pending++;
+  g_object_set_data(G_OBJECT(menubar), MENUBAR_DATA_LOADING,
+                    GINT_TO_POINTER(GPOINTER_TO_INT(g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_LOADING)) + 1));
 
-  return;
+  g_thread_pool_push(loader_pool, job, NULL);
 }
 
+/* Remembers where the indicator went, for the next start */
 static void
-menu_show (IndicatorObject * io, IndicatorObjectEntry * entry,
-           guint32 timestamp, gpointer user_data)
+load_job_set_order (load_job_t * job, IndicatorObject * io)
 {
-  GtkWidget * menubar = GTK_WIDGET(user_data);
+  discovery_cache_set_order(job->cache, job->name,
+                            GPOINTER_TO_INT(g_object_get_data(G_OBJECT(io), IO_DATA_ORDER_NUMBER)));
+}
 
-  if (entry == NULL) {
-    /* Close any open menus instead of opening one */
-    GList * l;
-    GList * entries = indicator_object_get_entries(io);
-    for (l = entries; l != NULL; l = g_list_next(entry)) {
-      IndicatorObjectEntry * entrydata = l->data;
-      gtk_menu_popdown(entrydata->menu);
+static void
+load_module_run (load_job_t * job)
+{
+  gchar * fullpath = g_build_filename(indicator_module_dir(), job->name, NULL);
+  gint64 span = applet_trace_begin();
+
+  job->module = g_module_open(fullpath, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+  if (job->module != NULL) {
+    gpointer get_type = NULL;
+    if (!g_module_symbol(job->module, INDICATOR_GET_TYPE_S, &get_type)) {
+      job->error = g_strdup(g_module_error());
+      g_module_close(job->module);
+      job->module = NULL;
     }
-    g_list_free(entries);
-
-    /* And tell the menubar to exit activation mode too */
-    gtk_menu_shell_cancel(GTK_MENU_SHELL(menubar));
-    return;
+  } else {
+    job->error = g_strdup(g_module_error());
   }
 
-  // TODO: do something sensible here
+  applet_trace_end(span, "open module", job->name);
+  g_free(fullpath);
 }
 
 static void
-update_accessible_desc(IndicatorObjectEntry * entry, GtkWidget * menuitem)
+load_module_finish (load_job_t * job)
 {
-  /* FIXME: We need to deal with the use case where the contents of the
-     label overrides what is found in the atk object's name, or at least
-     orca speaks the label instead of the atk object name.
-   */
-  AtkObject * menuitem_obj = gtk_widget_get_accessible(menuitem);
-  if (menuitem_obj == NULL) {
-    /* Should there be an error printed here? */
+  if (job->module == NULL) {
+    menubar_warning(job->menubar, "Unable to open module '%s': %s", job->name, job->error);
+    APPLET_PROBE(module_loaded, job->name, NULL);
     return;
   }
 
-  if (entry->accessible_desc != NULL) {
-    atk_object_set_name(menuitem_obj, entry->accessible_desc);
-  } else {
-    atk_object_set_name(menuitem_obj, "");
-  }
-  return;
-}
-
-static void load_indicator(GtkWidget * menubar, IndicatorObject *object, const gchar *name) {
-	GObject * o;
-	GList *entries, *entry;
-
-	/* Set the environment it's in */
-	indicator_object_set_environment(object, (GStrv)indicator_env);
-
-	/* Attach the 'name' to the object */
-	o = G_OBJECT (object);
-	g_object_set_data_full(o, IO_DATA_MENUITEM_LOOKUP, g_hash_table_new (g_direct_hash, g_direct_equal), (GDestroyNotify)g_hash_table_destroy);
-	g_object_set_data_full(o, IO_DATA_NAME, g_strdup(name), g_free);
-	
-	int pos = 5000 - indicator_object_get_position(object);
-	if (pos > 5000) {
-	    pos = name2order(name, NULL);
-	}
-	
-	g_object_set_data(o, IO_DATA_ORDER_NUMBER, GINT_TO_POINTER(pos));
-
-	/* Connect to its signals */
-	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ENTRY_ADDED,   G_CALLBACK(entry_added),    menubar);
-	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ENTRY_REMOVED, G_CALLBACK(entry_removed),  menubar);
-	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ENTRY_MOVED,   G_CALLBACK(entry_moved),    menubar);
-	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_MENU_SHOW,     G_CALLBACK(menu_show),      menubar);
-	g_signal_connect(o, INDICATOR_OBJECT_SIGNAL_ACCESSIBLE_DESC_UPDATE, G_CALLBACK(accessible_desc_update), menubar);
+  applet_log(menubar_get_variant(job->menubar)->log_name, "Loading Module: %s", job->name);
 
-	/* Work on the entries */
-	entries = indicator_object_get_entries(object);
+  /* The module is already mapped, so this only bumps its
+     reference count and creates the object. */
+  gchar * fullpath = g_build_filename(indicator_module_dir(), job->name, NULL);
+  gint64 span = applet_trace_begin();
+  IndicatorObject * io = indicator_object_new_from_file(fullpath);
+  applet_trace_end(span, "create module object", job->name);
+  g_free(fullpath);
 
-	for (entry = entries; entry != NULL; entry = g_list_next(entry)) {
-		IndicatorObjectEntry * entrydata = (IndicatorObjectEntry *) entry->data;
-		entry_added(object, entrydata, menubar);
-	}
+  if (io != NULL) {
+    load_indicator(job->menubar, io, job->name);
+    load_job_set_order(job, io);
+  }
 
-	g_list_free(entries);
+  APPLET_PROBE(module_loaded, job->name, io);
 }
 
 static gboolean
-load_module (const gchar * name, GtkWidget * menubar)
+load_module (const gchar * name, GtkWidget * menubar, DiscoveryCache * cache)
 {
-  
-  g_debug("Looking at Module: %s", name);
+  load_job_t * job;
+
+  applet_log(menubar_get_variant(menubar)->log_name, "Looking at Module: %s", name);
   g_return_val_if_fail(name != NULL, FALSE);
 
   if (!g_str_has_suffix(name, G_MODULE_SUFFIX)) {
     return FALSE;
   }
 
-  g_debug("Loading Module: %s", name);
+  APPLET_PROBE(module_load, name);
 
-  /* Build the object for the module */
-  gchar * fullpath = g_build_filename(INDICATOR_DIR, name, NULL);
-  IndicatorObject * io = indicator_object_new_from_file(fullpath);
-  g_free(fullpath);
-
-  load_indicator(menubar, io, name);
+  job = g_new0(load_job_t, 1);
+  job->run = load_module_run;
+  job->finish = load_module_finish;
+  job->cache = discovery_cache_ref(cache);
+  loader_push(job, name, menubar);
 
   return TRUE;
 }
 
-static void load_modules(GtkWidget *menubar, gint *indicators_loaded) {
-	if  (g_file_test(INDICATOR_DIR, (G_FILE_TEST_EXISTS | G_FILE_TEST_IS_DIR))) {
-		GDir * dir = g_dir_open(INDICATOR_DIR, 0, NULL);
+static void load_modules(GtkWidget *menubar, gint *indicators_queued) {
+	const applet_variant_t * variant = menubar_get_variant(menubar);
+	gchar * cachename = g_strconcat(variant->name, "-modules.cache", NULL);
+	DiscoveryCache * cache = discovery_cache_new(indicator_module_dir(), cachename);
+	const GPtrArray * names = discovery_cache_get_names(cache);
 
+	g_free(cachename);
+
+	if (names != NULL) {
 		const gchar * name;
 		gint count = 0;
-		while ((name = g_dir_read_name(dir)) != NULL) {
-			
-			#ifdef INDICATOR_APPLET_APPMENU
-				if (g_strcmp0(name, "libappmenu.so")) {
-					continue;
-				}
-			#else
-				if (!g_strcmp0(name, "libappmenu.so")) {
-					continue;
-				}
-			#endif
+		guint i;
+		for (i = 0; i < names->len; i++) {
+			name = g_ptr_array_index(names, i);
 			
-			#ifdef INDICATOR_APPLET
-				if (!g_strcmp0(name, "libsession.so")) {
-					continue;
-				}
-				if (!g_strcmp0(name, "libme.so")) {
-					continue;
-				}
-				if (!g_strcmp0(name, "libdatetime.so")) {
-					continue;
-				}
-			#endif
-			
-			#ifdef INDICATOR_APPLET_SESSION
-				if (g_strcmp0(name, "libsession.so") && g_strcmp0(name, "libme.so")) {
-					continue;
-				}
-			#endif
+			if (!variant_wants(&variant->include_modules, &variant->exclude_modules, name)) {
+				continue;
+			}
 
-			if (load_module(name, menubar)) {
+			if (load_module(name, menubar, cache)) {
 				count++;
 			}
 		}
 
-		*indicators_loaded += count;
-		
-		g_dir_close (dir);
+		*indicators_queued += count;
 	}
+
+	discovery_cache_unref(cache);
 }
 
-#define INDICATOR_SERVICE_DIR "/usr/share/unity/indicators"
+#define INDICATOR_SERVICE_PROFILE "desktop"
 
-static void load_indicators_from_indicator_files(GtkWidget *menubar, gint *indicators_loaded) {
-	GDir *dir;
-	const gchar *name;
-	GError *error = NULL;
+/* Only looks at whether the file changed since it was last
+   tried.  IndicatorNg reads the file itself and only takes its
+   path, so that one parse is what decides if it is any good, and
+   a file that failed it isn't tried again until it changes. */
+static void
+load_service_run (load_job_t * job)
+{
+  gint64 span = applet_trace_begin();
+
+  if (discovery_cache_get_state(job->cache, job->name) == DISCOVERY_CACHE_INVALID) {
+    job->error = g_strdup("service file is unchanged since it last failed to load");
+  }
+
+  applet_trace_end(span, "check service", job->name);
+}
+
+static void
+load_service_finish (load_job_t * job)
+{
+  gchar *filename;
+  IndicatorNg *indicator;
+  GError *error = NULL;
+  gint64 span;
+
+  if (job->error != NULL) {
+    menubar_warning (job->menubar, "unable to load '%s': %s", job->name, job->error);
+    return;
+  }
 
-	dir = g_dir_open (INDICATOR_SERVICE_DIR, 0, &error);
+  filename = g_build_filename (indicator_service_dir (), job->name, NULL);
+  span = applet_trace_begin ();
+  indicator = indicator_ng_new_for_profile (filename, INDICATOR_SERVICE_PROFILE, &error);
+  applet_trace_end (span, "create service", job->name);
+  g_free (filename);
+
+  discovery_cache_set_state (job->cache, job->name,
+                             indicator != NULL ? DISCOVERY_CACHE_VALID : DISCOVERY_CACHE_INVALID);
+
+  if (indicator) {
+    applet_log (menubar_get_variant (job->menubar)->log_name, "loading indicator: %s", job->name);
+    load_indicator(job->menubar, INDICATOR_OBJECT (indicator), job->name);
+    load_job_set_order(job, INDICATOR_OBJECT (indicator));
+  }else{
+    menubar_warning (job->menubar, "unable to load '%s': %s", job->name, error->message);
+    g_clear_error (&error);
+  }
+}
 
-	if (!dir) {
-		g_warning ("unable to open indicator service file directory: %s", error->message);
-  		g_error_free (error);
+static void load_indicators_from_indicator_files(GtkWidget *menubar, gint *indicators_queued) {
+	const applet_variant_t *variant = menubar_get_variant (menubar);
+	DiscoveryCache *cache;
+	const GPtrArray *names;
+	const gchar *name;
+	gchar *cachename;
+	guint i;
+
+	/* Each applet has its own caches, as they look at different
+	   files and write them back when they are done */
+	cachename = g_strconcat (variant->name, "-services.cache", NULL);
+	cache = discovery_cache_new (indicator_service_dir (), cachename);
+	g_free (cachename);
+	names = discovery_cache_get_names (cache);
+
+	if (!names) {
+		menubar_warning (menubar, "unable to open indicator service file directory: %s", indicator_service_dir ());
+		discovery_cache_unref (cache);
 		
   		return;
 	}
 	
 	gint count = 0;
-	while ((name = g_dir_read_name (dir))) {
-		gchar *filename;
-		IndicatorNg *indicator;
+	for (i = 0; i < names->len; i++) {
+		load_job_t *job;
 
-		filename = g_build_filename (INDICATOR_SERVICE_DIR, name, NULL);
-		indicator = indicator_ng_new_for_profile (filename, "desktop", &error);
-		g_free (filename);
+		name = g_ptr_array_index (names, i);
 
-		#ifdef INDICATOR_APPLET_APPMENU
-			if (g_strcmp0(name, "com.canonical.indicator.appmenu")) {
-				continue;
-			}
-		#else
-			if (!g_strcmp0(name, "com.canonical.indicator.appmenu")) {
-				continue;
-			}
-		#endif
-		
-		#ifdef INDICATOR_APPLET
-			if (!g_strcmp0(name, "com.canonical.indicator.session")) {
-				continue;
-			}
-			if (!g_strcmp0(name, "com.canonical.indicator.me")) {
-				continue;
-			}
-			if (!g_strcmp0(name, "com.canonical.indicator.datetime")) {
-				continue;
-			}
-		#endif
-		
-		#ifdef INDICATOR_APPLET_SESSION
-			if (g_strcmp0(name, "com.canonical.indicator.session") && g_strcmp0(name, "com.canonical.indicator.me")) {
-				continue;
-			}
-		#endif
-
-		if (indicator) {
-			g_debug ("loading indicator: %s", name);
-			load_indicator(menubar,INDICATOR_OBJECT (indicator), name);
-			count++;
-		}else{
-			g_warning ("unable to load '%s': %s", name, error->message);
-			g_clear_error (&error);
+		if (!variant_wants (&variant->include_services, &variant->exclude_services, name)) {
+			continue;
 		}
+
+		/* Only what passed the filters gets built */
+		job = g_new0(load_job_t, 1);
+		job->run = load_service_run;
+		job->finish = load_service_finish;
+		job->cache = discovery_cache_ref (cache);
+		loader_push(job, name, menubar);
+		count++;
 	}
 
-	*indicators_loaded += count;
+	*indicators_queued += count;
 
-	g_dir_close (dir);
+	discovery_cache_unref (cache);
 }
 
 static void
@@ -786,17 +1830,22 @@ hotkey_filter (char * keystring, gpointer data)
 {
   g_return_if_fail(GTK_IS_MENU_SHELL(data));
 
-  g_debug ("Hotkey: %s", keystring);
+  APPLET_PROBE(hotkey, keystring);
+  applet_log (menubar_get_variant (GTK_WIDGET (data))->log_name, "Hotkey: %s", keystring);
+
+  loader_flush();
 
   /* Oh, wow, it's us! */
   GList * children = gtk_container_get_children(GTK_CONTAINER(data));
   if (children == NULL) {
-    g_debug("Menubar has no children");
+    applet_log(menubar_get_variant(GTK_WIDGET(data))->log_name, "Menubar has no children");
+    APPLET_PROBE(hotkey_done, keystring);
     return;
   }
 
   gtk_menu_shell_select_item(GTK_MENU_SHELL(data), GTK_WIDGET(g_list_last(children)->data));
   g_list_free(children);
+  APPLET_PROBE(hotkey_done, keystring);
   return;
 }
 
@@ -805,6 +1854,8 @@ menubar_press (GtkWidget * widget,
                     GdkEventButton *event,
                     gpointer data G_GNUC_UNUSED)
 {
+  loader_flush();
+
   if (event->button != 1) {
     g_signal_stop_emission_by_name(widget, "button-press-event");
   }
@@ -812,16 +1863,27 @@ menubar_press (GtkWidget * widget,
   return FALSE;
 }
 
+static gboolean
+menubar_enter (GtkWidget * widget G_GNUC_UNUSED,
+               GdkEventCrossing * event G_GNUC_UNUSED,
+               gpointer data G_GNUC_UNUSED)
+{
+  loader_flush();
+
+  return FALSE;
+}
+
 static void
 #ifdef HAVE_LIBPANEL_APPLET
 about_cb (GSimpleAction *action G_GNUC_UNUSED,
           GVariant      *parameter G_GNUC_UNUSED,
-          gpointer       data G_GNUC_UNUSED)
+          gpointer       data)
 #else
 about_cb (GtkAction *action G_GNUC_UNUSED,
-          gpointer   data G_GNUC_UNUSED)
+          gpointer   data)
 #endif
 {
+  const applet_variant_t *variant = menubar_get_variant (GTK_WIDGET (data));
   static const gchar *authors[] = {
     "Ted Gould <ted@canonical.com>",
     NULL
@@ -844,28 +1906,10 @@ about_cb (GtkAction *action G_GNUC_UNUSED,
   license_i18n = g_strconcat (_(license[0]), "\n\n", _(license[1]), "\n\n", _(license[2]), NULL);
 
   gtk_show_about_dialog(NULL,
-#ifdef INDICATOR_APPLET
-    "program-name", _("Indicator Applet"),
-#endif
-#ifdef INDICATOR_APPLET_SESSION
-    "program-name", _("Indicator Applet Session"),
-#endif
-#ifdef INDICATOR_APPLET_COMPLETE
-    "program-name", _("Indicator Applet Complete"),
-#endif
-#ifdef INDICATOR_APPLET_APPMENU
-    "program-name", _("Indicator Applet Application Menu"),
-#endif
+    "program-name", _(variant->program_name),
     "version", VERSION,
     "copyright", "Copyright \xc2\xa9 2009-2010 Canonical, Ltd.",
-#ifdef INDICATOR_APPLET_SESSION
-    "comments", _("A place to adjust your status, change users or exit your session."),
-#else
-#ifdef INDICATOR_APPLET_APPMENU
-    "comments", _("An applet to hold your application menus."),
-#endif
-    "comments", _("An applet to hold all of the system indicators."),
-#endif
+    "comments", _(variant->comments),
     "authors", authors,
     "license", license_i18n,
     "wrap-license", TRUE,
@@ -882,82 +1926,281 @@ about_cb (GtkAction *action G_GNUC_UNUSED,
   return;
 }
 
-static gboolean
-swap_orient_cb (GtkWidget *item, gpointer data)
-{
-  GtkWidget *from = (GtkWidget *) data;
-  GtkWidget *to = (GtkWidget *) g_object_get_data(G_OBJECT(from), "to");
-  g_object_ref(G_OBJECT(item));
-  gtk_container_remove(GTK_CONTAINER(from), item);
-  if (GTK_IS_LABEL(item)) {
-      switch(packdirection) {
-      case GTK_PACK_DIRECTION_LTR:
-        gtk_label_set_angle(GTK_LABEL(item), 0.0);
-        break;
-      case GTK_PACK_DIRECTION_TTB:
-        gtk_label_set_angle(GTK_LABEL(item),
-            (orient == PANEL_APPLET_ORIENT_LEFT) ? 
-            270.0 : 90.0);
-        break;
-      default:
-        break;
-    }    
-  }
-  gtk_box_pack_start(GTK_BOX(to), item, FALSE, FALSE, 0);
-  return TRUE;
-}
+/* Turns a menuitem's box and label to suit the menubar, changing
+   only what differs.  Nothing is taken apart or rebuilt. */
+static void
+reorient_menuitem (GtkWidget * menuitem, gpointer user_data)
+{
+  GtkWidget * menubar = GTK_WIDGET(user_data);
+  menuitem_data_t * data = menuitem_get_data(menuitem);
+  GtkOrientation orientation =
+      (gtk_menu_bar_get_pack_direction(GTK_MENU_BAR(menubar)) == GTK_PACK_DIRECTION_LTR) ?
+      GTK_ORIENTATION_HORIZONTAL : GTK_ORIENTATION_VERTICAL;
 
-static gboolean
-reorient_box_cb (GtkWidget *menuitem, gpointer data)
-{
-  GtkWidget *from = g_object_get_data(G_OBJECT(menuitem), MENU_DATA_BOX);
-  GtkWidget *to = (packdirection == GTK_PACK_DIRECTION_LTR) ?
-      gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0) : gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-  g_object_set_data(G_OBJECT(from), "to", to);
-  gtk_container_foreach(GTK_CONTAINER(from), (GtkCallback)swap_orient_cb,
-      from);
-  gtk_container_remove(GTK_CONTAINER(menuitem), from);
-  gtk_container_add(GTK_CONTAINER(menuitem), to);
-  g_object_set_data(G_OBJECT(menuitem), MENU_DATA_BOX, to);
-  gtk_widget_show_all(menuitem);
-  return TRUE;
+  if (gtk_orientable_get_orientation(GTK_ORIENTABLE(data->box)) != orientation) {
+    gtk_orientable_set_orientation(GTK_ORIENTABLE(data->box), orientation);
+  }
+
+  if (data->entry != NULL && data->entry->label != NULL) {
+    GtkLabel * label = data->entry->label;
+    gdouble angle = menubar_get_label_angle(menubar);
+
+    if (gtk_label_get_angle(label) != angle) {
+      gtk_label_set_angle(label, angle);
+    }
+  }
 }
 
 static gboolean
-panelapplet_reorient_cb (GtkWidget *applet, PanelAppletOrient neworient,
+panelapplet_reorient_cb (GtkWidget *applet G_GNUC_UNUSED, PanelAppletOrient neworient,
     gpointer data)
 {
   GtkWidget *menubar = (GtkWidget *)data;
-  if ((((neworient == PANEL_APPLET_ORIENT_UP) || 
-      (neworient == PANEL_APPLET_ORIENT_DOWN)) && 
-      ((orient == PANEL_APPLET_ORIENT_LEFT) || 
-      (orient == PANEL_APPLET_ORIENT_RIGHT))) || 
-      (((neworient == PANEL_APPLET_ORIENT_LEFT) || 
-      (neworient == PANEL_APPLET_ORIENT_RIGHT)) && 
-      ((orient == PANEL_APPLET_ORIENT_UP) ||
-      (orient == PANEL_APPLET_ORIENT_DOWN)))) {
-    packdirection = (packdirection == GTK_PACK_DIRECTION_LTR) ?
-        GTK_PACK_DIRECTION_TTB : GTK_PACK_DIRECTION_LTR;
-    gtk_menu_bar_set_pack_direction(GTK_MENU_BAR(menubar),
-        packdirection);
-    orient = neworient;
-    gtk_container_foreach(GTK_CONTAINER(menubar),
-        (GtkCallback)reorient_box_cb, NULL);
-  }
-  orient = neworient;
+  PanelAppletOrient orient = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_ORIENT));
+  GtkPackDirection packdirection = ((neworient == PANEL_APPLET_ORIENT_UP) ||
+      (neworient == PANEL_APPLET_ORIENT_DOWN)) ?
+      GTK_PACK_DIRECTION_LTR : GTK_PACK_DIRECTION_TTB;
+
+  if (neworient == orient) {
+    return FALSE;
+  }
+
+  /* Going from one side to the other only turns the labels round */
+  g_object_set_data(G_OBJECT(menubar), MENUBAR_DATA_ORIENT, GINT_TO_POINTER(neworient));
+  if (gtk_menu_bar_get_pack_direction(GTK_MENU_BAR(menubar)) != packdirection) {
+    gtk_menu_bar_set_pack_direction(GTK_MENU_BAR(menubar), packdirection);
+  }
+
+  /* One pass over the menuitems.  The changes only queue a
+     resize, so the menubar is laid out once on the next frame. */
+  gtk_container_foreach(GTK_CONTAINER(menubar), reorient_menuitem, menubar);
+
   return FALSE;
 }
 
+/*************
+ * accounting
+ * ***********/
+
+/* Counts the widgets in a menu and its submenus */
+static guint
+count_menu_widgets (GtkWidget * widget)
+{
+  guint count = 1;
+
+  if (GTK_IS_MENU_ITEM(widget)) {
+    GtkWidget * submenu = gtk_menu_item_get_submenu(GTK_MENU_ITEM(widget));
+    if (submenu != NULL) {
+      count += count_menu_widgets(submenu);
+    }
+  }
+
+  if (GTK_IS_CONTAINER(widget)) {
+    GList * children = gtk_container_get_children(GTK_CONTAINER(widget));
+    GList * child;
+
+    for (child = children; child != NULL; child = g_list_next(child)) {
+      count += count_menu_widgets(GTK_WIDGET(child->data));
+    }
+    g_list_free(children);
+  }
+
+  return count;
+}
+
+/* What each indicator is holding on to, so growth of the panel
+   can be put down to one of them.  It is only worked out when
+   the log is dumped, so the menubar pays nothing for it. */
+static void
+menubar_report (GString * out, gpointer user_data)
+{
+  GtkWidget * menubar = GTK_WIDGET(user_data);
+  GPtrArray * indicators = g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_INDICATORS);
+  GList * children = gtk_container_get_children(GTK_CONTAINER(menubar));
+  guint i;
+
+  g_string_append_printf(out, "Menubar %p: %u menuitems, %u pooled for the process\n",
+                         menubar, g_list_length(children), menuitem_pool.length);
+  g_list_free(children);
+
+  for (i = 0; i < indicators->len; i++) {
+    IndicatorObject * io = g_ptr_array_index(indicators, i);
+    GHashTable * menuitem_lookup = g_object_get_data(G_OBJECT(io), IO_DATA_MENUITEM_LOOKUP);
+    GList * entries = indicator_object_get_entries(io);
+    GList * l;
+    GHashTableIter iter;
+    gpointer value;
+    guint menuitems = 0, hidden = 0, submenu_widgets = 0;
+
+    for (l = entries; l != NULL; l = g_list_next(l)) {
+      IndicatorObjectEntry * entry = l->data;
+      if (entry->menu != NULL) {
+        submenu_widgets += count_menu_widgets(GTK_WIDGET(entry->menu));
+      }
+    }
+
+    /* Menuitems are only in the lookup table until their
+       removal is flushed, and hidden ones are kept as well */
+    g_hash_table_iter_init(&iter, menuitem_lookup);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      GtkWidget * menuitem = GTK_WIDGET(value);
+      if (gtk_widget_get_parent(menuitem) == menubar) {
+        menuitems++;
+        if (!gtk_widget_get_visible(menuitem)) {
+          hidden++;
+        }
+      }
+    }
+
+    g_string_append_printf(out, "  %s: %u entries, %u menuitems, %u hidden, %u in lookup, %u submenu widgets\n",
+                           (const gchar *)g_object_get_data(G_OBJECT(io), IO_DATA_NAME),
+                           g_list_length(entries), menuitems, hidden,
+                           g_hash_table_size(menuitem_lookup), submenu_widgets);
+    g_list_free(entries);
+  }
+}
+
+static void
+menubar_destroyed (GtkWidget * menubar, gpointer user_data G_GNUC_UNUSED)
+{
+  applet_log_remove_report(menubar_report, menubar);
+}
+
 #ifdef N_
 #undef N_
 #endif
 #define N_(x) x
 
+/* Builds the menubar the indicators go in, with everything
+   the rest of the applet keeps on it */
+static GtkWidget *
+menubar_new (const applet_variant_t * variant, PanelAppletOrient orient)
+{
+  GtkWidget *menubar = gtk_menu_bar_new();
+  GtkPackDirection packdirection;
+
+  g_object_set_data(G_OBJECT(menubar), MENUBAR_DATA_VARIANT, (gpointer)variant);
+  g_object_set_data_full(G_OBJECT(menubar), MENUBAR_DATA_INDEX,
+                         g_sequence_new(g_free), (GDestroyNotify)g_sequence_free);
+  g_object_set_data_full(G_OBJECT(menubar), MENUBAR_DATA_UPDATES,
+                         update_queue_new(), update_queue_free);
+  g_object_set_data_full(G_OBJECT(menubar), MENUBAR_DATA_INDICATORS,
+                         g_ptr_array_new_with_free_func(g_object_unref),
+                         (GDestroyNotify)g_ptr_array_unref);
+
+  g_object_set_data(G_OBJECT(menubar), MENUBAR_DATA_ORIENT, GINT_TO_POINTER(orient));
+  packdirection = ((orient == PANEL_APPLET_ORIENT_UP) ||
+      (orient == PANEL_APPLET_ORIENT_DOWN)) ? 
+      GTK_PACK_DIRECTION_LTR : GTK_PACK_DIRECTION_TTB;
+  gtk_menu_bar_set_pack_direction(GTK_MENU_BAR(menubar),
+      packdirection);
+  gtk_widget_set_can_focus (GTK_WIDGET (menubar), TRUE);
+  gtk_widget_set_name(GTK_WIDGET (menubar), "fast-user-switch-menubar");
+  gtk_widget_add_events(menubar, GDK_ENTER_NOTIFY_MASK);
+  g_signal_connect(menubar, "button-press-event", G_CALLBACK(menubar_press), NULL);
+  g_signal_connect(menubar, "enter-notify-event", G_CALLBACK(menubar_enter), NULL);
+  gtk_container_set_border_width(GTK_CONTAINER(menubar), 0);
+
+  applet_log_add_report(variant->log_name, menubar_report, menubar);
+  g_signal_connect(menubar, "destroy", G_CALLBACK(menubar_destroyed), NULL);
+
+  return menubar;
+}
+
+/*************
+ * for the benchmark
+ * ***********/
+
+GtkWidget *
+indicator_applet_menubar_new (const gchar * factory_id, PanelAppletOrient orient)
+{
+  const applet_variant_t * variant = variant_lookup(factory_id);
+
+  g_return_val_if_fail(variant != NULL, NULL);
+
+  return menubar_new(variant, orient);
+}
+
+void
+indicator_applet_menubar_add_indicator (GtkWidget * menubar, IndicatorObject * io,
+                                        const gchar * name)
+{
+  load_indicator(menubar, io, name);
+}
+
+/* Starts loading what is in the indicator directories, and
+   gives how many indicators are being tried */
+gint
+indicator_applet_menubar_load (GtkWidget * menubar)
+{
+  gint indicators_queued = 0;
+
+  load_modules(menubar, &indicators_queued);
+  load_indicators_from_indicator_files(menubar, &indicators_queued);
+
+  return indicators_queued;
+}
+
+/* How many of the menubar's indicators are still being tried */
+guint
+indicator_applet_menubar_loading (GtkWidget * menubar)
+{
+  return GPOINTER_TO_INT(g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_LOADING));
+}
+
+/* Applies the queued changes now instead of on the next frame */
+void
+indicator_applet_menubar_flush (GtkWidget * menubar)
+{
+  update_queue_t * queue = g_object_get_data(G_OBJECT(menubar), MENUBAR_DATA_UPDATES);
+
+  if (queue->tick_id != 0) {
+    gtk_widget_remove_tick_callback(menubar, queue->tick_id);
+    update_queue_flush(menubar, NULL, queue);
+  }
+}
+
+void
+indicator_applet_menubar_reorient (GtkWidget * menubar, PanelAppletOrient orient)
+{
+  panelapplet_reorient_cb(NULL, orient, menubar);
+}
+
+/* Marks the first time the menubar is mapped and drawn on the
+   startup timeline, if there is one */
+static void
+trace_first_map (GtkWidget * menubar, gpointer user_data)
+{
+  g_signal_handlers_disconnect_by_func(menubar, trace_first_map, user_data);
+  applet_trace_instant("menubar mapped", user_data);
+}
+
 static gboolean
-applet_fill_cb (PanelApplet * applet, const gchar * iid G_GNUC_UNUSED,
-                gpointer data G_GNUC_UNUSED)
+trace_first_draw (GtkWidget * menubar, cairo_t * cr G_GNUC_UNUSED, gpointer user_data)
+{
+  g_signal_handlers_disconnect_by_func(menubar, trace_first_draw, user_data);
+  applet_trace_instant("menubar drawn", user_data);
+  trace_drawn = TRUE;
+  trace_startup_progress();
+  return FALSE;
+}
+
+/* Called by each of the applet factories, with its
+   factory id as @data */
+gboolean
+indicator_applet_fill (PanelApplet * applet, const gchar * iid G_GNUC_UNUSED,
+                       gpointer data)
 {
+  const applet_variant_t * variant = variant_lookup((const gchar *)data);
+  gboolean tracing = applet_trace_init();
+  gint64 fill_span = applet_trace_begin();
+  gint64 span;
+
+  g_return_val_if_fail(variant != NULL, FALSE);
+
+  span = applet_trace_begin();
   ido_init();
+  applet_trace_end(span, "ido_init", NULL);
 
 #ifdef HAVE_LIBPANEL_APPLET
   static const GActionEntry menu_actions[] = {
@@ -979,32 +2222,35 @@ applet_fill_cb (PanelApplet * applet, const gchar * iid G_GNUC_UNUSED,
 
   static gboolean first_time = FALSE;
   GtkWidget *menubar;
-  gint indicators_loaded = 0;
+  gint indicators_queued = 0;
 #ifdef HAVE_LIBPANEL_APPLET
   GSimpleActionGroup *action_group;
 #else
   GtkActionGroup *action_group;
 #endif
 
-#ifdef INDICATOR_APPLET_SESSION
+  applet_log_init(variant->log_name);
+
   /* check if we are running stracciatella session */
-  if (g_strcmp0(g_getenv("GDMSESSION"), "gnome-stracciatella") == 0) {
-    g_debug("Running stracciatella GNOME session, disabling myself");
+  if (variant->skip_in_stracciatella &&
+      g_strcmp0(g_getenv("GDMSESSION"), "gnome-stracciatella") == 0) {
+    applet_log(variant->log_name, "Running stracciatella GNOME session, disabling myself");
     return TRUE;
   }
-#endif
 
   if (!first_time)
   {
     first_time = TRUE;
 
+    span = applet_trace_begin();
     tomboy_keybinder_init();
+    applet_trace_end(span, "tomboy_keybinder_init", NULL);
   }
 
   /* Set panel options */
   gtk_container_set_border_width(GTK_CONTAINER (applet), 0);
   panel_applet_set_flags(applet, PANEL_APPLET_EXPAND_MINOR);
-  menubar = gtk_menu_bar_new();
+  menubar = menubar_new(variant, panel_applet_get_orient(applet));
 
 #ifdef HAVE_LIBPANEL_APPLET
   action_group = g_simple_action_group_new ();
@@ -1023,62 +2269,49 @@ applet_fill_cb (PanelApplet * applet, const gchar * iid G_GNUC_UNUSED,
   g_object_unref(action_group);
 #endif
 
-#ifdef INDICATOR_APPLET
-  atk_object_set_name (gtk_widget_get_accessible (GTK_WIDGET (applet)),
-                       "indicator-applet");
-#endif
-#ifdef INDICATOR_APPLET_SESSION
   atk_object_set_name (gtk_widget_get_accessible (GTK_WIDGET (applet)),
-                       "indicator-applet-session");
-#endif
-#ifdef INDICATOR_APPLET_COMPLETE
-  atk_object_set_name (gtk_widget_get_accessible (GTK_WIDGET (applet)),
-                       "indicator-applet-complete");
-#endif
-#ifdef INDICATOR_APPLET_APPMENU
-  atk_object_set_name (gtk_widget_get_accessible (GTK_WIDGET (applet)),
-                       "indicator-applet-appmenu");
-#endif
+                       variant->name);
 
   /* Init some theme/icon stuff */
+  span = applet_trace_begin();
   gtk_icon_theme_append_search_path(gtk_icon_theme_get_default(),
                                     INDICATOR_ICONS_DIR);
-  g_debug("Icons directory: %s", INDICATOR_ICONS_DIR);
+  applet_trace_end(span, "icon theme", INDICATOR_ICONS_DIR);
+  applet_log(variant->log_name, "Icons directory: %s", INDICATOR_ICONS_DIR);
 
   gtk_widget_set_name(GTK_WIDGET (applet), "fast-user-switch-applet");
 
-  /* Build menubar */
-  orient = (panel_applet_get_orient(applet));
-  packdirection = ((orient == PANEL_APPLET_ORIENT_UP) ||
-      (orient == PANEL_APPLET_ORIENT_DOWN)) ? 
-      GTK_PACK_DIRECTION_LTR : GTK_PACK_DIRECTION_TTB;
-  gtk_menu_bar_set_pack_direction(GTK_MENU_BAR(menubar),
-      packdirection);
-  gtk_widget_set_can_focus (GTK_WIDGET (menubar), TRUE);
-  gtk_widget_set_name(GTK_WIDGET (menubar), "fast-user-switch-menubar");
-  g_signal_connect(menubar, "button-press-event", G_CALLBACK(menubar_press), NULL);
   g_signal_connect(applet, "change-orient", 
       G_CALLBACK(panelapplet_reorient_cb), menubar);
-  gtk_container_set_border_width(GTK_CONTAINER(menubar), 0);
 
   /* Add in filter func */
-  tomboy_keybinder_bind(hotkey_keycode, hotkey_filter, menubar);
+  tomboy_keybinder_bind(variant->hotkey, hotkey_filter, menubar);
 
 	/* load indicators */
-	load_modules(menubar, &indicators_loaded);
-	load_indicators_from_indicator_files(menubar, &indicators_loaded);
-
-  if (indicators_loaded == 0) {
-    /* A label to allow for click through */
-    GtkWidget * item = gtk_label_new(_("No Indicators"));
-    gtk_container_add(GTK_CONTAINER(applet), item);
-    gtk_widget_show(item);
+	span = applet_trace_begin();
+	load_modules(menubar, &indicators_queued);
+	applet_trace_end(span, "scan modules", indicator_module_dir());
+
+	span = applet_trace_begin();
+	load_indicators_from_indicator_files(menubar, &indicators_queued);
+	applet_trace_end(span, "scan services", indicator_service_dir());
+
+  /* With indicators to try the menubar goes in, and is swapped
+     for the label later if none of them can be loaded */
+  if (indicators_queued == 0) {
+    applet_show_no_indicators(GTK_WIDGET(applet));
   } else {
     gtk_container_add(GTK_CONTAINER(applet), menubar);
+    if (tracing) {
+      g_signal_connect_after(menubar, "map", G_CALLBACK(trace_first_map), (gpointer)variant->factory_id);
+      g_signal_connect_after(menubar, "draw", G_CALLBACK(trace_first_draw), (gpointer)variant->factory_id);
+    }
     gtk_widget_show(menubar);
   }
 
   gtk_widget_show(GTK_WIDGET(applet));
 
+  applet_trace_end(fill_span, "indicator_applet_fill", variant->factory_id);
+
   return TRUE;
 }
@@ -0,0 +1,47 @@
+/*
+Entry point shared by the indicator applet factories, which all
+build their applets from the same code.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLET_MAIN_H__
+#define __APPLET_MAIN_H__
+
+#include <panel-applet.h>
+#include <libindicator/indicator-object.h>
+
+G_BEGIN_DECLS
+
+gboolean indicator_applet_fill (PanelApplet * applet,
+                                const gchar * iid,
+                                gpointer      data);
+
+/* For the benchmark in bench/, which drives a menubar without
+   a panel around it */
+GtkWidget * indicator_applet_menubar_new           (const gchar       * factory_id,
+                                                    PanelAppletOrient   orient);
+void        indicator_applet_menubar_add_indicator (GtkWidget         * menubar,
+                                                    IndicatorObject   * io,
+                                                    const gchar       * name);
+gint        indicator_applet_menubar_load          (GtkWidget         * menubar);
+guint       indicator_applet_menubar_loading       (GtkWidget         * menubar);
+void        indicator_applet_menubar_flush         (GtkWidget         * menubar);
+void        indicator_applet_menubar_reorient      (GtkWidget         * menubar,
+                                                    PanelAppletOrient   orient);
+
+G_END_DECLS
+
+#endif /* __APPLET_MAIN_H__ */
@@ -0,0 +1,52 @@
+/*
+Static probe points for tracing a running applet with perf,
+bpftrace or systemtap, e.g.
+
+  bpftrace -e 'usdt:/usr/lib/.../libindicator-applet-core.so:indicator_applet:entry_added
+               { printf("%s %p\n", str(arg0), arg1); }' -p $(pidof gnome-panel)
+
+When nothing is attached a probe is a single nop.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLET_PROBES_H__
+#define __APPLET_PROBES_H__
+
+#include <glib.h>
+
+#ifdef HAVE_SYS_SDT_H
+
+/* Every probe gets a semaphore that the tracer raises while it
+   is attached, so arguments that take work to find, like the name
+   of an indicator, are only found when someone is looking. */
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define APPLET_PROBE_DECLARE(name) \
+  static volatile unsigned short indicator_applet_##name##_semaphore \
+    __attribute__((used, section(".probes")))
+#define APPLET_PROBE_ENABLED(name)  G_UNLIKELY(indicator_applet_##name##_semaphore != 0)
+#define APPLET_PROBE(name, ...)     STAP_PROBEV(indicator_applet, name, ##__VA_ARGS__)
+
+#else
+
+#define APPLET_PROBE_DECLARE(name)  struct _applet_probe_##name
+#define APPLET_PROBE_ENABLED(name)  FALSE
+#define APPLET_PROBE(name, ...)     G_STMT_START { } G_STMT_END
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* __APPLET_PROBES_H__ */
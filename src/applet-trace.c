@@ -0,0 +1,261 @@
+/*
+An optional timeline of the applet starting up, written in the
+trace event format that chrome://tracing and Perfetto open.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <unistd.h>
+
+#include "applet-trace.h"
+
+/* Tracing is on when $INDICATOR_APPLET_TRACE names the file to
+   write the timeline to.  Spans are timed with the monotonic
+   clock in microseconds, which is what the format wants, and
+   kept in memory until the file is written.  Once the timeline
+   is finished nothing more is kept. */
+#define TRACE_ENV  "INDICATOR_APPLET_TRACE"
+
+typedef struct _trace_event_t trace_event_t;
+struct _trace_event_t {
+  gchar phase;                  /* 'X' for a span, 'i' for an instant */
+  const gchar * name;
+  gchar * detail;
+  gint64 start;
+  gint64 duration;
+  gint thread;
+};
+
+static gchar * trace_file = NULL;
+static GArray * trace_events = NULL;
+static GMutex trace_lock;
+static gint trace_threads = 0;
+static GPrivate trace_thread = G_PRIVATE_INIT(NULL);
+
+/* Small numbers for the threads, the first one being the main
+   thread that turned tracing on */
+static gint
+thread_id (void)
+{
+  gint id = GPOINTER_TO_INT(g_private_get(&trace_thread));
+
+  if (id == 0) {
+    id = g_atomic_int_add(&trace_threads, 1) + 1;
+    g_private_set(&trace_thread, GINT_TO_POINTER(id));
+  }
+
+  return id;
+}
+
+static void
+trace_add (gchar phase, const gchar * name, const gchar * detail,
+           gint64 start, gint64 duration)
+{
+  trace_event_t event;
+
+  event.phase = phase;
+  event.name = name;
+  event.detail = g_strdup(detail);
+  event.start = start;
+  event.duration = duration;
+  event.thread = thread_id();
+
+  /* Loader threads may still be at it when the timeline is
+     finished */
+  g_mutex_lock(&trace_lock);
+  if (trace_events != NULL) {
+    g_array_append_val(trace_events, event);
+  } else {
+    g_free(event.detail);
+  }
+  g_mutex_unlock(&trace_lock);
+}
+
+/**
+ * applet_trace_init:
+ *
+ * Turns tracing on if the environment asks for it.  Only the
+ * first call does anything.
+ *
+ * Return value: whether tracing is on
+ */
+gboolean
+applet_trace_init (void)
+{
+  static gboolean initialized = FALSE;
+  const gchar * file;
+
+  if (initialized) {
+    return trace_events != NULL;
+  }
+  initialized = TRUE;
+
+  file = g_getenv(TRACE_ENV);
+  if (file == NULL || file[0] == '\0') {
+    return FALSE;
+  }
+
+  trace_file = g_strdup(file);
+  trace_events = g_array_new(FALSE, FALSE, sizeof(trace_event_t));
+  thread_id();
+
+  return TRUE;
+}
+
+/* Starts a span, giving 0 when tracing is off */
+gint64
+applet_trace_begin (void)
+{
+  return trace_events != NULL ? g_get_monotonic_time() : 0;
+}
+
+/**
+ * applet_trace_end:
+ * @start: what applet_trace_begin() gave
+ * @name: a string literal for what was done
+ * @detail: what it was done to, like a file name, or %NULL
+ *
+ * Ends a span.  Safe to call from any thread.
+ */
+void
+applet_trace_end (gint64 start, const gchar * name, const gchar * detail)
+{
+  if (trace_events == NULL || start == 0) {
+    return;
+  }
+
+  trace_add('X', name, detail, start, g_get_monotonic_time() - start);
+}
+
+void
+applet_trace_instant (const gchar * name, const gchar * detail)
+{
+  if (trace_events == NULL) {
+    return;
+  }
+
+  trace_add('i', name, detail, g_get_monotonic_time(), 0);
+}
+
+static void
+append_json_string (GString * out, const gchar * str)
+{
+  const gchar * c;
+
+  g_string_append_c(out, '"');
+  for (c = str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      g_string_append_c(out, '\\');
+      g_string_append_c(out, *c);
+    } else if ((guchar)*c < 0x20) {
+      g_string_append_printf(out, "\\u%04x", (guchar)*c);
+    } else {
+      g_string_append_c(out, *c);
+    }
+  }
+  g_string_append_c(out, '"');
+}
+
+/**
+ * applet_trace_write:
+ *
+ * Writes everything traced so far to the file, replacing what
+ * an earlier call wrote.
+ */
+void
+applet_trace_write (void)
+{
+  GString * out;
+  GError * error = NULL;
+  gint pid = getpid();
+  gint threads;
+  guint i;
+
+  if (trace_events == NULL) {
+    return;
+  }
+
+  out = g_string_new("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  /* The main thread took the first number when tracing was
+     turned on, so there is always one thread */
+  threads = g_atomic_int_get(&trace_threads);
+  for (i = 1; i <= (guint)threads; i++) {
+    g_string_append_printf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,"
+                           "\"args\":{\"name\":\"%s\"}}",
+                           i == 1 ? "" : ",\n", pid, i, i == 1 ? "main" : "loader");
+  }
+
+  g_mutex_lock(&trace_lock);
+  for (i = 0; i < trace_events->len; i++) {
+    const trace_event_t * event = &g_array_index(trace_events, trace_event_t, i);
+    gchar * name = event->detail != NULL ?
+        g_strconcat(event->name, " ", event->detail, NULL) : g_strdup(event->name);
+
+    g_string_append_printf(out, ",\n{\"ph\":\"%c\",\"cat\":\"startup\",\"pid\":%d,\"tid\":%d,"
+                           "\"ts\":%" G_GINT64_FORMAT ",",
+                           event->phase, pid, event->thread, event->start);
+    if (event->phase == 'X') {
+      g_string_append_printf(out, "\"dur\":%" G_GINT64_FORMAT ",", event->duration);
+    } else {
+      g_string_append(out, "\"s\":\"p\",");
+    }
+    g_string_append(out, "\"name\":");
+    append_json_string(out, name);
+    g_string_append_c(out, '}');
+
+    g_free(name);
+  }
+  g_mutex_unlock(&trace_lock);
+
+  g_string_append(out, "\n]}\n");
+
+  if (!g_file_set_contents(trace_file, out->str, out->len, &error)) {
+    g_warning("Unable to write trace '%s': %s", trace_file, error->message);
+    g_error_free(error);
+  }
+
+  g_string_free(out, TRUE);
+}
+
+/**
+ * applet_trace_finish:
+ *
+ * Writes the file a last time and stops tracing, so the events
+ * don't pile up for the life of the panel.
+ */
+void
+applet_trace_finish (void)
+{
+  GArray * events;
+  guint i;
+
+  if (trace_events == NULL) {
+    return;
+  }
+
+  applet_trace_write();
+
+  g_mutex_lock(&trace_lock);
+  events = trace_events;
+  trace_events = NULL;
+  g_mutex_unlock(&trace_lock);
+
+  for (i = 0; i < events->len; i++) {
+    g_free(g_array_index(events, trace_event_t, i).detail);
+  }
+  g_array_free(events, TRUE);
+  g_clear_pointer(&trace_file, g_free);
+}
@@ -0,0 +1,39 @@
+/*
+An optional timeline of the applet starting up, written in the
+trace event format that chrome://tracing and Perfetto open.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __APPLET_TRACE_H__
+#define __APPLET_TRACE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean    applet_trace_init    (void);
+gint64      applet_trace_begin   (void);
+void        applet_trace_end     (gint64        start,
+                                  const gchar * name,
+                                  const gchar * detail);
+void        applet_trace_instant (const gchar * name,
+                                  const gchar * detail);
+void        applet_trace_write   (void);
+void        applet_trace_finish  (void);
+
+G_END_DECLS
+
+#endif /* __APPLET_TRACE_H__ */
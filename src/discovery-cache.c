@@ -0,0 +1,432 @@
+/*
+A small on-disk cache of the contents of the indicator directories
+so that a warm start doesn't need to walk them or parse their files.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "applet-log.h"
+#include "discovery-cache.h"
+
+/* The file is a header, followed by a fixed size record for every
+   file in the directory, followed by the NUL terminated names the
+   records point into.  It is only ever read by the machine that
+   wrote it, so everything is in native byte order. */
+#define CACHE_MAGIC    "IACACHE"
+#define CACHE_VERSION  2
+
+typedef struct _cache_header_t cache_header_t;
+struct _cache_header_t {
+  gchar   magic[8];
+  guint32 version;
+  guint32 n_records;
+  guint64 dir_ino;
+  gint64  dir_mtime;
+  guint32 strings_size;
+  guint32 padding;
+};
+
+typedef struct _cache_record_t cache_record_t;
+struct _cache_record_t {
+  guint64 ino;
+  gint64  mtime;
+  guint32 name_offset;
+  guint32 state;
+  gint32  order;
+  guint32 padding;
+};
+
+typedef struct _record_t record_t;
+struct _record_t {
+  gchar * name;
+  guint64 ino;
+  gint64 mtime;
+  DiscoveryCacheState state;
+  gint order;
+};
+
+struct _DiscoveryCache {
+  gint ref_count;
+  gchar * dirname;
+  gchar * cachefile;
+  guint64 dir_ino;
+  gint64 dir_mtime;
+  GHashTable * records;     /* name -> record_t */
+  GPtrArray * names;        /* borrowed from the records */
+  GMutex lock;
+  gboolean exists;
+  gboolean dirty;
+};
+
+static void
+record_free (gpointer data)
+{
+  record_t * record = (record_t *)data;
+  g_free(record->name);
+  g_free(record);
+}
+
+static record_t *
+record_add (DiscoveryCache * cache, const gchar * name)
+{
+  record_t * record = g_new0(record_t, 1);
+  record->name = g_strdup(name);
+  record->state = DISCOVERY_CACHE_UNKNOWN;
+  record->order = DISCOVERY_CACHE_NO_ORDER;
+
+  g_hash_table_insert(cache->records, record->name, record);
+  g_ptr_array_add(cache->names, record->name);
+
+  return record;
+}
+
+static gboolean
+stat_path (const gchar * path, guint64 * ino, gint64 * mtime)
+{
+  struct stat buf;
+
+  if (stat(path, &buf) != 0) {
+    return FALSE;
+  }
+
+  *ino = buf.st_ino;
+  *mtime = (gint64)buf.st_mtim.tv_sec * 1000000000 + buf.st_mtim.tv_nsec;
+  return TRUE;
+}
+
+/* Loads the records from the cache file.  Returns TRUE only if
+   they describe the directory as it is right now. */
+static gboolean
+cache_read (DiscoveryCache * cache)
+{
+  GMappedFile * mapped;
+  const gchar * contents;
+  const cache_header_t * header;
+  const cache_record_t * records;
+  const gchar * strings;
+  gsize length;
+  gboolean fresh = FALSE;
+  guint i;
+
+  mapped = g_mapped_file_new(cache->cachefile, FALSE, NULL);
+  if (mapped == NULL) {
+    return FALSE;
+  }
+
+  contents = g_mapped_file_get_contents(mapped);
+  length = g_mapped_file_get_length(mapped);
+
+  if (length < sizeof(cache_header_t)) {
+    goto out;
+  }
+
+  header = (const cache_header_t *)contents;
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != CACHE_VERSION) {
+    goto out;
+  }
+
+  length -= sizeof(cache_header_t);
+  if (header->n_records > length / sizeof(cache_record_t) ||
+      length - header->n_records * sizeof(cache_record_t) != header->strings_size) {
+    goto out;
+  }
+
+  records = (const cache_record_t *)(contents + sizeof(cache_header_t));
+  strings = (const gchar *)(records + header->n_records);
+
+  /* With a terminated table every offset inside it is a string */
+  if (header->strings_size > 0 && strings[header->strings_size - 1] != '\0') {
+    goto out;
+  }
+
+  for (i = 0; i < header->n_records; i++) {
+    if (records[i].name_offset >= header->strings_size) {
+      g_hash_table_remove_all(cache->records);
+      g_ptr_array_set_size(cache->names, 0);
+      goto out;
+    }
+  }
+
+  for (i = 0; i < header->n_records; i++) {
+    record_t * record = record_add(cache, strings + records[i].name_offset);
+    record->ino = records[i].ino;
+    record->mtime = records[i].mtime;
+    if (records[i].state <= DISCOVERY_CACHE_INVALID) {
+      record->state = records[i].state;
+    }
+    record->order = records[i].order;
+  }
+
+  fresh = (header->dir_ino == cache->dir_ino &&
+           header->dir_mtime == cache->dir_mtime);
+
+out:
+  g_mapped_file_unref(mapped);
+  return fresh;
+}
+
+/* Walks the directory, keeping the records for files that are
+   still there so only new or changed ones need looking at. */
+static void
+cache_scan (DiscoveryCache * cache)
+{
+  GHashTable * old = cache->records;
+  GDir * dir;
+  const gchar * name;
+
+  cache->records = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, record_free);
+  g_ptr_array_set_size(cache->names, 0);
+  cache->dirty = TRUE;
+
+  dir = g_dir_open(cache->dirname, 0, NULL);
+  if (dir != NULL) {
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      record_t * record = g_hash_table_lookup(old, name);
+      if (record != NULL) {
+        g_hash_table_steal(old, name);
+        g_hash_table_insert(cache->records, record->name, record);
+        g_ptr_array_add(cache->names, record->name);
+      } else {
+        record_add(cache, name);
+      }
+    }
+    g_dir_close(dir);
+  }
+
+  g_hash_table_destroy(old);
+}
+
+static void
+cache_write (DiscoveryCache * cache)
+{
+  cache_header_t header;
+  GByteArray * data;
+  GString * strings;
+  GError * error = NULL;
+  gchar * cachedir;
+  guint i;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.version = CACHE_VERSION;
+  header.n_records = cache->names->len;
+  header.dir_ino = cache->dir_ino;
+  header.dir_mtime = cache->dir_mtime;
+
+  data = g_byte_array_new();
+  strings = g_string_new(NULL);
+  g_byte_array_append(data, (const guint8 *)&header, sizeof(header));
+
+  for (i = 0; i < cache->names->len; i++) {
+    const record_t * record = g_hash_table_lookup(cache->records,
+                                                  g_ptr_array_index(cache->names, i));
+    cache_record_t out;
+
+    memset(&out, 0, sizeof(out));
+    out.ino = record->ino;
+    out.mtime = record->mtime;
+    out.name_offset = strings->len;
+    out.state = record->state;
+    out.order = record->order;
+
+    g_byte_array_append(data, (const guint8 *)&out, sizeof(out));
+    g_string_append_len(strings, record->name, strlen(record->name) + 1);
+  }
+
+  ((cache_header_t *)data->data)->strings_size = strings->len;
+  g_byte_array_append(data, (const guint8 *)strings->str, strings->len);
+
+  cachedir = g_path_get_dirname(cache->cachefile);
+  g_mkdir_with_parents(cachedir, 0700);
+  g_free(cachedir);
+
+  if (!g_file_set_contents(cache->cachefile, (const gchar *)data->data, data->len, &error)) {
+    g_warning("Unable to write discovery cache '%s': %s", cache->cachefile, error->message);
+    g_error_free(error);
+  }
+
+  g_string_free(strings, TRUE);
+  g_byte_array_free(data, TRUE);
+}
+
+/**
+ * discovery_cache_new:
+ * @dirname: directory to look in
+ * @cachename: file name of the cache in the user's cache directory
+ *
+ * Finds the files in @dirname.  When the directory hasn't changed
+ * since the cache was written the names come straight from the
+ * cache and the directory isn't read at all.
+ */
+DiscoveryCache *
+discovery_cache_new (const gchar * dirname, const gchar * cachename)
+{
+  DiscoveryCache * cache = g_new0(DiscoveryCache, 1);
+
+  cache->ref_count = 1;
+  cache->dirname = g_strdup(dirname);
+  cache->cachefile = g_build_filename(g_get_user_cache_dir(), "indicator-applet", cachename, NULL);
+  cache->records = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, record_free);
+  cache->names = g_ptr_array_new();
+  g_mutex_init(&cache->lock);
+
+  cache->exists = stat_path(dirname, &cache->dir_ino, &cache->dir_mtime);
+  if (!cache->exists) {
+    return cache;
+  }
+
+  if (!cache_read(cache)) {
+    applet_log(NULL, "Discovery cache for %s is stale, rescanning", dirname);
+    cache_scan(cache);
+  }
+
+  return cache;
+}
+
+DiscoveryCache *
+discovery_cache_ref (DiscoveryCache * cache)
+{
+  g_atomic_int_inc(&cache->ref_count);
+  return cache;
+}
+
+/* Dropping the last reference writes back anything that changed */
+void
+discovery_cache_unref (DiscoveryCache * cache)
+{
+  if (!g_atomic_int_dec_and_test(&cache->ref_count)) {
+    return;
+  }
+
+  if (cache->dirty) {
+    cache_write(cache);
+  }
+
+  g_mutex_clear(&cache->lock);
+  g_ptr_array_free(cache->names, TRUE);
+  g_hash_table_destroy(cache->records);
+  g_free(cache->cachefile);
+  g_free(cache->dirname);
+  g_free(cache);
+}
+
+/* The names of all the files in the directory, or NULL
+   if there is no such directory */
+const GPtrArray *
+discovery_cache_get_names (DiscoveryCache * cache)
+{
+  return cache->exists ? cache->names : NULL;
+}
+
+/**
+ * discovery_cache_get_state:
+ * @cache: a #DiscoveryCache
+ * @name: a file in the cached directory
+ *
+ * Returns the remembered verdict on @name, or
+ * %DISCOVERY_CACHE_UNKNOWN if the file changed since.
+ * Safe to call from any thread.
+ */
+DiscoveryCacheState
+discovery_cache_get_state (DiscoveryCache * cache, const gchar * name)
+{
+  DiscoveryCacheState state = DISCOVERY_CACHE_UNKNOWN;
+  const record_t * record;
+  gchar * path;
+  guint64 ino;
+  gint64 mtime;
+
+  path = g_build_filename(cache->dirname, name, NULL);
+  if (stat_path(path, &ino, &mtime)) {
+    g_mutex_lock(&cache->lock);
+    record = g_hash_table_lookup(cache->records, name);
+    if (record != NULL && record->ino == ino && record->mtime == mtime) {
+      state = record->state;
+    }
+    g_mutex_unlock(&cache->lock);
+  }
+  g_free(path);
+
+  return state;
+}
+
+/* Remembers the verdict on @name for the file as it is now */
+void
+discovery_cache_set_state (DiscoveryCache * cache, const gchar * name,
+                           DiscoveryCacheState state)
+{
+  record_t * record;
+  gchar * path;
+  guint64 ino;
+  gint64 mtime;
+
+  path = g_build_filename(cache->dirname, name, NULL);
+  if (stat_path(path, &ino, &mtime)) {
+    g_mutex_lock(&cache->lock);
+    record = g_hash_table_lookup(cache->records, name);
+    if (record != NULL && (record->ino != ino || record->mtime != mtime ||
+                           record->state != state)) {
+      record->ino = ino;
+      record->mtime = mtime;
+      record->state = state;
+      cache->dirty = TRUE;
+    }
+    g_mutex_unlock(&cache->lock);
+  }
+  g_free(path);
+}
+
+/**
+ * discovery_cache_get_order:
+ * @cache: a #DiscoveryCache
+ * @name: a file in the cached directory
+ *
+ * Returns where the indicator in @name went in the menubar the
+ * last time it was loaded, or %DISCOVERY_CACHE_NO_ORDER.  It is
+ * only a hint for what to load first, so the file isn't checked.
+ */
+gint
+discovery_cache_get_order (DiscoveryCache * cache, const gchar * name)
+{
+  gint order = DISCOVERY_CACHE_NO_ORDER;
+  const record_t * record;
+
+  g_mutex_lock(&cache->lock);
+  record = g_hash_table_lookup(cache->records, name);
+  if (record != NULL) {
+    order = record->order;
+  }
+  g_mutex_unlock(&cache->lock);
+
+  return order;
+}
+
+void
+discovery_cache_set_order (DiscoveryCache * cache, const gchar * name, gint order)
+{
+  record_t * record;
+
+  g_mutex_lock(&cache->lock);
+  record = g_hash_table_lookup(cache->records, name);
+  if (record != NULL && record->order != order) {
+    record->order = order;
+    cache->dirty = TRUE;
+  }
+  g_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,58 @@
+/*
+A small on-disk cache of the contents of the indicator directories
+so that a warm start doesn't need to walk them or parse their files.
+
+Copyright 2026 The Indicator Applet Developers
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DISCOVERY_CACHE_H__
+#define __DISCOVERY_CACHE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DiscoveryCache DiscoveryCache;
+
+typedef enum {
+  DISCOVERY_CACHE_UNKNOWN = 0,
+  DISCOVERY_CACHE_VALID,
+  DISCOVERY_CACHE_INVALID
+} DiscoveryCacheState;
+
+#define DISCOVERY_CACHE_NO_ORDER  G_MAXINT32
+
+DiscoveryCache *    discovery_cache_new       (const gchar    * dirname,
+                                               const gchar    * cachename);
+DiscoveryCache *    discovery_cache_ref       (DiscoveryCache * cache);
+void                discovery_cache_unref     (DiscoveryCache * cache);
+
+const GPtrArray *   discovery_cache_get_names (DiscoveryCache * cache);
+
+DiscoveryCacheState discovery_cache_get_state (DiscoveryCache * cache,
+                                               const gchar    * name);
+void                discovery_cache_set_state (DiscoveryCache * cache,
+                                               const gchar    * name,
+                                               DiscoveryCacheState state);
+
+gint                discovery_cache_get_order (DiscoveryCache * cache,
+                                               const gchar    * name);
+void                discovery_cache_set_order (DiscoveryCache * cache,
+                                               const gchar    * name,
+                                               gint             order);
+
+G_END_DECLS
+
+#endif /* __DISCOVERY_CACHE_H__ */
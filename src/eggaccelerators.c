@@ -19,9 +19,11 @@
 
 #include "eggaccelerators.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <gdk/gdkx.h>
 #include <gdk/gdkkeysyms.h>
+#include <X11/XKBlib.h>
 
 enum
 {
@@ -42,136 +44,138 @@ typedef struct
 {
   EggVirtualModifierType mapping[EGG_MODMAP_ENTRY_LAST];
 
+  /* The XKB keyboard description the mapping was made from,
+   * and what has changed in it since.
+   */
+  XkbDescPtr xkb;
+  XkbMapChangesRec changes;
+  int xkb_event_base;
+  gboolean reload;
+  gboolean stale;
 } EggModmap;
 
 const EggModmap* egg_keymap_get_modmap (GdkKeymap *keymap);
 
-static inline gboolean
-is_alt (const gchar *string)
+/* Names accepted between angle brackets, sorted for bsearch() */
+typedef struct
 {
-  return ((string[0] == '<') &&
-	  (string[1] == 'a' || string[1] == 'A') &&
-	  (string[2] == 'l' || string[2] == 'L') &&
-	  (string[3] == 't' || string[3] == 'T') &&
-	  (string[4] == '>'));
-}
+  const gchar *name;
+  EggVirtualModifierType mask;
+} EggModifierName;
+
+static const EggModifierName modifier_names[] = {
+  { "alt",     EGG_VIRTUAL_ALT_MASK },
+  { "control", EGG_VIRTUAL_CONTROL_MASK },
+  { "ctl",     EGG_VIRTUAL_CONTROL_MASK },
+  { "ctrl",    EGG_VIRTUAL_CONTROL_MASK },
+  { "hyper",   EGG_VIRTUAL_HYPER_MASK },
+  { "meta",    EGG_VIRTUAL_META_MASK },
+  { "mod1",    EGG_VIRTUAL_ALT_MASK },
+  { "mod2",    EGG_VIRTUAL_MOD2_MASK },
+  { "mod3",    EGG_VIRTUAL_MOD3_MASK },
+  { "mod4",    EGG_VIRTUAL_MOD4_MASK },
+  { "mod5",    EGG_VIRTUAL_MOD5_MASK },
+  { "release", EGG_VIRTUAL_RELEASE_MASK },
+  { "shft",    EGG_VIRTUAL_SHIFT_MASK },
+  { "shift",   EGG_VIRTUAL_SHIFT_MASK },
+  { "super",   EGG_VIRTUAL_SUPER_MASK }
+};
 
-static inline gboolean
-is_ctl (const gchar *string)
-{
-  return ((string[0] == '<') &&
-	  (string[1] == 'c' || string[1] == 'C') &&
-	  (string[2] == 't' || string[2] == 'T') &&
-	  (string[3] == 'l' || string[3] == 'L') &&
-	  (string[4] == '>'));
-}
+/* Longer than any of the names above */
+#define MODIFIER_NAME_MAX 8
 
-static inline gboolean
-is_modx (const gchar *string)
+static int
+compare_modifier_name (const void *key,
+                       const void *entry)
 {
-  return ((string[0] == '<') &&
-	  (string[1] == 'm' || string[1] == 'M') &&
-	  (string[2] == 'o' || string[2] == 'O') &&
-	  (string[3] == 'd' || string[3] == 'D') &&
-	  (string[4] >= '1' && string[4] <= '5') &&
-	  (string[5] == '>'));
+  return strcmp ((const gchar *) key,
+                 ((const EggModifierName *) entry)->name);
 }
 
-static inline gboolean
-is_ctrl (const gchar *string)
+/* Looks up the @len characters at @name, in any case.
+ * Returns 0 if they don't name a modifier.
+ */
+static EggVirtualModifierType
+lookup_modifier (const gchar *name,
+                 gsize        len)
 {
-  return ((string[0] == '<') &&
-	  (string[1] == 'c' || string[1] == 'C') &&
-	  (string[2] == 't' || string[2] == 'T') &&
-	  (string[3] == 'r' || string[3] == 'R') &&
-	  (string[4] == 'l' || string[4] == 'L') &&
-	  (string[5] == '>'));
-}
+  gchar lower[MODIFIER_NAME_MAX + 1];
+  const EggModifierName *found;
+  gsize i;
 
-static inline gboolean
-is_shft (const gchar *string)
-{
-  return ((string[0] == '<') &&
-	  (string[1] == 's' || string[1] == 'S') &&
-	  (string[2] == 'h' || string[2] == 'H') &&
-	  (string[3] == 'f' || string[3] == 'F') &&
-	  (string[4] == 't' || string[4] == 'T') &&
-	  (string[5] == '>'));
-}
+  if (len == 0 || len > MODIFIER_NAME_MAX)
+    return 0;
 
-static inline gboolean
-is_shift (const gchar *string)
-{
-  return ((string[0] == '<') &&
-	  (string[1] == 's' || string[1] == 'S') &&
-	  (string[2] == 'h' || string[2] == 'H') &&
-	  (string[3] == 'i' || string[3] == 'I') &&
-	  (string[4] == 'f' || string[4] == 'F') &&
-	  (string[5] == 't' || string[5] == 'T') &&
-	  (string[6] == '>'));
-}
+  for (i = 0; i < len; ++i)
+    lower[i] = g_ascii_tolower (name[i]);
+  lower[len] = '\0';
 
-static inline gboolean
-is_control (const gchar *string)
-{
-  return ((string[0] == '<') &&
-	  (string[1] == 'c' || string[1] == 'C') &&
-	  (string[2] == 'o' || string[2] == 'O') &&
-	  (string[3] == 'n' || string[3] == 'N') &&
-	  (string[4] == 't' || string[4] == 'T') &&
-	  (string[5] == 'r' || string[5] == 'R') &&
-	  (string[6] == 'o' || string[6] == 'O') &&
-	  (string[7] == 'l' || string[7] == 'L') &&
-	  (string[8] == '>'));
-}
+  found = bsearch (lower, modifier_names,
+                   G_N_ELEMENTS (modifier_names),
+                   sizeof (EggModifierName),
+                   compare_modifier_name);
 
-static inline gboolean
-is_release (const gchar *string)
-{
-  return ((string[0] == '<') &&
-	  (string[1] == 'r' || string[1] == 'R') &&
-	  (string[2] == 'e' || string[2] == 'E') &&
-	  (string[3] == 'l' || string[3] == 'L') &&
-	  (string[4] == 'e' || string[4] == 'E') &&
-	  (string[5] == 'a' || string[5] == 'A') &&
-	  (string[6] == 's' || string[6] == 'S') &&
-	  (string[7] == 'e' || string[7] == 'E') &&
-	  (string[8] == '>'));
+  return found ? found->mask : 0;
 }
 
-static inline gboolean
-is_meta (const gchar *string)
+/* Accelerators are parsed again whenever the keymap changes,
+ * but what they parse to never does.
+ */
+typedef struct
 {
-  return ((string[0] == '<') &&
-	  (string[1] == 'm' || string[1] == 'M') &&
-	  (string[2] == 'e' || string[2] == 'E') &&
-	  (string[3] == 't' || string[3] == 'T') &&
-	  (string[4] == 'a' || string[4] == 'A') &&
-	  (string[5] == '>'));
-}
+  guint keyval;
+  EggVirtualModifierType mods;
+  gboolean valid;
+} EggParsedAccelerator;
 
-static inline gboolean
-is_super (const gchar *string)
-{
-  return ((string[0] == '<') &&
-	  (string[1] == 's' || string[1] == 'S') &&
-	  (string[2] == 'u' || string[2] == 'U') &&
-	  (string[3] == 'p' || string[3] == 'P') &&
-	  (string[4] == 'e' || string[4] == 'E') &&
-	  (string[5] == 'r' || string[5] == 'R') &&
-	  (string[6] == '>'));
-}
+static GHashTable *parsed_accelerators = NULL;
 
-static inline gboolean
-is_hyper (const gchar *string)
+static gboolean
+parse_accelerator (const gchar            *accelerator,
+                   guint                  *accelerator_key,
+                   EggVirtualModifierType *accelerator_mods)
 {
-  return ((string[0] == '<') &&
-	  (string[1] == 'h' || string[1] == 'H') &&
-	  (string[2] == 'y' || string[2] == 'Y') &&
-	  (string[3] == 'p' || string[3] == 'P') &&
-	  (string[4] == 'e' || string[4] == 'E') &&
-	  (string[5] == 'r' || string[5] == 'R') &&
-	  (string[6] == '>'));
+  guint keyval;
+  EggVirtualModifierType mods;
+  gboolean bad_keyval;
+
+  bad_keyval = FALSE;
+  keyval = 0;
+  mods = 0;
+
+  while (*accelerator)
+    {
+      if (*accelerator == '<')
+        {
+          const gchar *name = accelerator + 1;
+          const gchar *end = strchr (name, '>');
+
+          /* An unterminated modifier can't be followed by a key */
+          if (end == NULL)
+            {
+              bad_keyval = TRUE;
+              break;
+            }
+
+          /* Unknown modifiers are skipped */
+          mods |= lookup_modifier (name, end - name);
+          accelerator = end + 1;
+        }
+      else
+        {
+          keyval = gdk_keyval_from_name (accelerator);
+
+          if (keyval == 0)
+            bad_keyval = TRUE;
+
+          break;
+        }
+    }
+
+  *accelerator_key = gdk_keyval_to_lower (keyval);
+  *accelerator_mods = mods;
+
+  return !bad_keyval;
 }
 
 /**
@@ -204,10 +208,7 @@ egg_accelerator_parse_virtual (const gchar            *accelerator,
                                guint                  *accelerator_key,
                                EggVirtualModifierType *accelerator_mods)
 {
-  guint keyval;
-  GdkModifierType mods;
-  gint len;
-  gboolean bad_keyval;
+  EggParsedAccelerator *parsed;
   
   if (accelerator_key)
     *accelerator_key = 0;
@@ -216,118 +217,31 @@ egg_accelerator_parse_virtual (const gchar            *accelerator,
 
   g_return_val_if_fail (accelerator != NULL, FALSE);
 
-  bad_keyval = FALSE;
-  
-  keyval = 0;
-  mods = 0;
-  len = strlen (accelerator);
-  while (len)
+  if (parsed_accelerators == NULL)
+    parsed_accelerators = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+
+  parsed = g_hash_table_lookup (parsed_accelerators, accelerator);
+  if (parsed == NULL)
     {
-      if (*accelerator == '<')
-	{
-	  if (len >= 9 && is_release (accelerator))
-	    {
-	      accelerator += 9;
-	      len -= 9;
-	      mods |= EGG_VIRTUAL_RELEASE_MASK;
-	    }
-	  else if (len >= 9 && is_control (accelerator))
-	    {
-	      accelerator += 9;
-	      len -= 9;
-	      mods |= EGG_VIRTUAL_CONTROL_MASK;
-	    }
-	  else if (len >= 7 && is_shift (accelerator))
-	    {
-	      accelerator += 7;
-	      len -= 7;
-	      mods |= EGG_VIRTUAL_SHIFT_MASK;
-	    }
-	  else if (len >= 6 && is_shft (accelerator))
-	    {
-	      accelerator += 6;
-	      len -= 6;
-	      mods |= EGG_VIRTUAL_SHIFT_MASK;
-	    }
-	  else if (len >= 6 && is_ctrl (accelerator))
-	    {
-	      accelerator += 6;
-	      len -= 6;
-	      mods |= EGG_VIRTUAL_CONTROL_MASK;
-	    }
-	  else if (len >= 6 && is_modx (accelerator))
-	    {
-	      static const guint mod_vals[] = {
-		EGG_VIRTUAL_ALT_MASK, EGG_VIRTUAL_MOD2_MASK, EGG_VIRTUAL_MOD3_MASK,
-		EGG_VIRTUAL_MOD4_MASK, EGG_VIRTUAL_MOD5_MASK
-	      };
-
-	      len -= 6;
-	      accelerator += 4;
-	      mods |= mod_vals[*accelerator - '1'];
-	      accelerator += 2;
-	    }
-	  else if (len >= 5 && is_ctl (accelerator))
-	    {
-	      accelerator += 5;
-	      len -= 5;
-	      mods |= EGG_VIRTUAL_CONTROL_MASK;
-	    }
-	  else if (len >= 5 && is_alt (accelerator))
-	    {
-	      accelerator += 5;
-	      len -= 5;
-	      mods |= EGG_VIRTUAL_ALT_MASK;
-	    }
-          else if (len >= 6 && is_meta (accelerator))
-	    {
-	      accelerator += 6;
-	      len -= 6;
-	      mods |= EGG_VIRTUAL_META_MASK;
-	    }
-          else if (len >= 7 && is_hyper (accelerator))
-	    {
-	      accelerator += 7;
-	      len -= 7;
-	      mods |= EGG_VIRTUAL_HYPER_MASK;
-	    }
-          else if (len >= 7 && is_super (accelerator))
-	    {
-	      accelerator += 7;
-	      len -= 7;
-	      mods |= EGG_VIRTUAL_SUPER_MASK;
-	    }
-	  else
-	    {
-	      gchar last_ch;
-	      
-	      last_ch = *accelerator;
-	      while (last_ch && last_ch != '>')
-		{
-		  last_ch = *accelerator;
-		  accelerator += 1;
-		  len -= 1;
-		}
-	    }
-	}
-      else
-	{
-          keyval = gdk_keyval_from_name (accelerator);
-          
-          if (keyval == 0)
-            bad_keyval = TRUE;
-          
-          accelerator += len;
-          len -= len;              
-	}
+      parsed = g_new0 (EggParsedAccelerator, 1);
+      parsed->valid = parse_accelerator (accelerator,
+                                         &parsed->keyval,
+                                         &parsed->mods);
+      g_hash_table_insert (parsed_accelerators,
+                           g_strdup (accelerator),
+                           parsed);
     }
-  
+
+  if (!parsed->valid)
+    return FALSE;
+
   if (accelerator_key)
-    *accelerator_key = gdk_keyval_to_lower (keyval);
+    *accelerator_key = parsed->keyval;
   if (accelerator_mods)
-    *accelerator_mods = mods;
+    *accelerator_mods = parsed->mods;
 
-  return !bad_keyval;
+  return TRUE;
 }
 
 
@@ -408,6 +322,21 @@ egg_keymap_virtualize_modifiers (GdkKeymap              *keymap,
   *virtual_mods = virtual;
 }
 
+/* Add in the not-really-virtual fixed entries */
+static void
+add_fixed_entries (EggModmap *modmap)
+{
+  modmap->mapping[EGG_MODMAP_ENTRY_SHIFT] |= EGG_VIRTUAL_SHIFT_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_CONTROL] |= EGG_VIRTUAL_CONTROL_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_LOCK] |= EGG_VIRTUAL_LOCK_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_MOD1] |= EGG_VIRTUAL_ALT_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_MOD2] |= EGG_VIRTUAL_MOD2_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_MOD3] |= EGG_VIRTUAL_MOD3_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_MOD4] |= EGG_VIRTUAL_MOD4_MASK;
+  modmap->mapping[EGG_MODMAP_ENTRY_MOD5] |= EGG_VIRTUAL_MOD5_MASK;
+}
+
+/* Core protocol version, for servers without XKB */
 static void
 reload_modmap (GdkKeymap *keymap,
                EggModmap *modmap)
@@ -481,19 +410,181 @@ reload_modmap (GdkKeymap *keymap,
       ++i;
     }
 
-  /* Add in the not-really-virtual fixed entries */
-  modmap->mapping[EGG_MODMAP_ENTRY_SHIFT] |= EGG_VIRTUAL_SHIFT_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_CONTROL] |= EGG_VIRTUAL_CONTROL_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_LOCK] |= EGG_VIRTUAL_LOCK_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_MOD1] |= EGG_VIRTUAL_ALT_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_MOD2] |= EGG_VIRTUAL_MOD2_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_MOD3] |= EGG_VIRTUAL_MOD3_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_MOD4] |= EGG_VIRTUAL_MOD4_MASK;
-  modmap->mapping[EGG_MODMAP_ENTRY_MOD5] |= EGG_VIRTUAL_MOD5_MASK;
+  add_fixed_entries (modmap);
   
   XFreeModifiermap (xmodmap);
 }
 
+/* The keysyms that make a modifier key one of the virtual
+ * modifiers, sorted by keysym for bsearch().
+ */
+typedef struct
+{
+  guint keysym;
+  EggVirtualModifierType mask;
+} EggVirtualKeysym;
+
+static const EggVirtualKeysym virtual_keysyms[] = {
+  { GDK_KEY_Scroll_Lock, EGG_VIRTUAL_SCROLL_LOCK_MASK },
+  { GDK_KEY_Mode_switch, EGG_VIRTUAL_MODE_SWITCH_MASK },
+  { GDK_KEY_Num_Lock,    EGG_VIRTUAL_NUM_LOCK_MASK },
+  { GDK_KEY_Meta_L,      EGG_VIRTUAL_META_MASK },
+  { GDK_KEY_Meta_R,      EGG_VIRTUAL_META_MASK },
+  { GDK_KEY_Super_L,     EGG_VIRTUAL_SUPER_MASK },
+  { GDK_KEY_Super_R,     EGG_VIRTUAL_SUPER_MASK },
+  { GDK_KEY_Hyper_L,     EGG_VIRTUAL_HYPER_MASK },
+  { GDK_KEY_Hyper_R,     EGG_VIRTUAL_HYPER_MASK }
+};
+
+static int
+compare_virtual_keysym (const void *key,
+                        const void *entry)
+{
+  guint keysym = *(const guint *) key;
+  guint other = ((const EggVirtualKeysym *) entry)->keysym;
+
+  return (keysym > other) - (keysym < other);
+}
+
+static EggVirtualModifierType
+keysym_to_virtual (guint keysym)
+{
+  const EggVirtualKeysym *found;
+
+  /* They all live on the same keysym page */
+  if ((keysym & ~0xff) != 0xff00)
+    return 0;
+
+  found = bsearch (&keysym, virtual_keysyms,
+                   G_N_ELEMENTS (virtual_keysyms),
+                   sizeof (EggVirtualKeysym),
+                   compare_virtual_keysym);
+
+  return found ? found->mask : 0;
+}
+
+/* Works out the modmap from the keyboard description we hold,
+ * without talking to the server.
+ */
+static void
+rebuild_modmap (EggModmap *modmap)
+{
+  XkbDescPtr xkb = modmap->xkb;
+  int keycode;
+  int i;
+
+  memset (modmap->mapping, 0, sizeof (modmap->mapping));
+
+  for (keycode = xkb->min_key_code; keycode <= xkb->max_key_code; ++keycode)
+    {
+      unsigned char mods = xkb->map->modmap[keycode];
+      KeySym *keysyms;
+      EggVirtualModifierType mask;
+      int n_keysyms;
+      int j;
+
+      /* there are 8 modifiers, and the first 3 are shift, shift lock,
+       * and control
+       */
+      if ((mods & ~(ShiftMask | LockMask | ControlMask)) == 0)
+        continue;
+
+      keysyms = XkbKeySymsPtr (xkb, keycode);
+      n_keysyms = XkbKeyNumSyms (xkb, keycode);
+
+      mask = 0;
+      for (j = 0; j < n_keysyms; ++j)
+        mask |= keysym_to_virtual (keysyms[j]);
+
+      for (i = EGG_MODMAP_ENTRY_MOD1; i < EGG_MODMAP_ENTRY_LAST; ++i)
+        {
+          if (mods & MODMAP_ENTRY_TO_MODIFIER (i))
+            modmap->mapping[i] |= mask;
+        }
+    }
+
+  add_fixed_entries (modmap);
+}
+
+/* Notes what XKB says changed, so the next lookup only fetches that.
+ * A new keyboard means starting over.
+ */
+static GdkFilterReturn
+modmap_filter (GdkXEvent *gdk_xevent,
+               GdkEvent  *event G_GNUC_UNUSED,
+               gpointer   data)
+{
+  XkbEvent *xkbev = (XkbEvent *) gdk_xevent;
+  EggModmap *modmap = data;
+
+  if (xkbev->type != modmap->xkb_event_base)
+    return GDK_FILTER_CONTINUE;
+
+  switch (xkbev->any.xkb_type)
+    {
+    case XkbMapNotify:
+      XkbNoteMapChanges (&modmap->changes, &xkbev->map,
+                         XkbKeySymsMask | XkbModifierMapMask);
+      modmap->stale = TRUE;
+      break;
+
+    case XkbNewKeyboardNotify:
+      modmap->reload = TRUE;
+      modmap->stale = TRUE;
+      break;
+
+    default:
+      break;
+    }
+
+  return GDK_FILTER_CONTINUE;
+}
+
+static void
+update_modmap (GdkKeymap *keymap,
+               EggModmap *modmap)
+{
+  /* FIXME multihead */
+  Display *display = gdk_x11_get_default_xdisplay ();
+
+  if (modmap->xkb == NULL || modmap->reload)
+    {
+      if (modmap->xkb != NULL)
+        XkbFreeKeyboard (modmap->xkb, 0, True);
+
+      /* The key symbols and modifier map of every key at once */
+      modmap->xkb = XkbGetMap (display,
+                               XkbKeySymsMask | XkbModifierMapMask,
+                               XkbUseCoreKbd);
+      modmap->reload = FALSE;
+    }
+  else if (modmap->changes.changed != 0)
+    {
+      XkbGetMapChanges (display, modmap->xkb, &modmap->changes);
+    }
+
+  memset (&modmap->changes, 0, sizeof (modmap->changes));
+
+  if (modmap->xkb != NULL)
+    rebuild_modmap (modmap);
+  else
+    reload_modmap (keymap, modmap);
+}
+
+static void
+free_modmap (gpointer data)
+{
+  EggModmap *modmap = data;
+
+  if (modmap->xkb_event_base >= 0)
+    gdk_window_remove_filter (NULL, modmap_filter, modmap);
+
+  if (modmap->xkb != NULL)
+    XkbFreeKeyboard (modmap->xkb, 0, True);
+
+  g_free (modmap);
+}
+
 const EggModmap*
 egg_keymap_get_modmap (GdkKeymap *keymap)
 {
@@ -508,18 +599,48 @@ egg_keymap_get_modmap (GdkKeymap *keymap)
 
   if (modmap == NULL)
     {
+      Display *display = gdk_x11_get_default_xdisplay ();
+      int opcode, error_base, major, minor;
+
       modmap = g_new0 (EggModmap, 1);
+      modmap->xkb_event_base = -1;
 
-      /* FIXME modify keymap change events with an event filter
-       * and force a reload if we get one
+      major = XkbMajorVersion;
+      minor = XkbMinorVersion;
+
+      /* Without XKB we fall back to the core protocol and
+       * never hear about changes.
        */
-      
-      reload_modmap (keymap, modmap);
-      
+      if (XkbQueryExtension (display, &opcode, &modmap->xkb_event_base,
+                             &error_base, &major, &minor))
+        {
+          XkbSelectEvents (display, XkbUseCoreKbd,
+                           XkbMapNotifyMask | XkbNewKeyboardNotifyMask,
+                           XkbMapNotifyMask | XkbNewKeyboardNotifyMask);
+          gdk_window_add_filter (NULL, modmap_filter, modmap);
+          modmap->reload = TRUE;
+        }
+      else
+        {
+          modmap->xkb_event_base = -1;
+        }
+
+      modmap->stale = TRUE;
+
       g_object_set_data_full (G_OBJECT (keymap),
                               "egg-modmap",
                               modmap,
-                              g_free);
+                              free_modmap);
+    }
+
+  if (modmap->stale)
+    {
+      if (modmap->xkb_event_base >= 0)
+        update_modmap (keymap, modmap);
+      else
+        reload_modmap (keymap, modmap);
+
+      modmap->stale = FALSE;
     }
 
   g_assert (modmap != NULL);
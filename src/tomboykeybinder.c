@@ -15,12 +15,17 @@
  * License along with this library; if not, write to the
  * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA 
  */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <string.h>
 
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 #include <X11/Xlib.h>
 
+#include "applet-probes.h"
 #include "eggaccelerators.h"
 #include "tomboykeybinder.h"
 
@@ -33,6 +38,11 @@
 #  define TRACE(x) do {} while (FALSE);
 #endif
 
+APPLET_PROBE_DECLARE (filter_key);
+APPLET_PROBE_DECLARE (filter_key_done);
+APPLET_PROBE_DECLARE (grab_key);
+APPLET_PROBE_DECLARE (grab_key_done);
+
 typedef struct _Binding {
 	TomboyBindkeyHandler  handler;
 	gpointer              user_data;
@@ -42,64 +52,282 @@ typedef struct _Binding {
 } Binding;
 
 static GSList *bindings = NULL;
+static GHashTable *binding_index = NULL;
+static gboolean filter_installed = FALSE;
 static guint32 last_event_time = 0;
 static gboolean processing_event = FALSE;
 
 static guint num_lock_mask, caps_lock_mask, scroll_lock_mask;
 
+/* Layout switches send several keys_changed in a row */
+#define KEYMAP_CHANGED_DELAY 100
+
+static guint keymap_changed_id = 0;
+
+/* One bit for every keycode that is bound to a modifier */
+static guint8 modifier_keycodes [256 / 8];
+static gboolean modifier_keycodes_valid = FALSE;
+
 static void
-lookup_ignorable_modifiers (GdkKeymap *keymap)
+lookup_ignorable_modifiers (GdkKeymap *keymap,
+			    guint     *num_lock,
+			    guint     *caps_lock,
+			    guint     *scroll_lock)
 {
 	egg_keymap_resolve_virtual_modifiers (keymap, 
 					      EGG_VIRTUAL_LOCK_MASK,
-					      &caps_lock_mask);
+					      caps_lock);
 
 	egg_keymap_resolve_virtual_modifiers (keymap, 
 					      EGG_VIRTUAL_NUM_LOCK_MASK,
-					      &num_lock_mask);
+					      num_lock);
 
 	egg_keymap_resolve_virtual_modifiers (keymap, 
 					      EGG_VIRTUAL_SCROLL_LOCK_MASK,
-					      &scroll_lock_mask);
+					      scroll_lock);
+}
+
+/*
+ * Bindings are also indexed by what the filter sees of a key press,
+ * the keycode and the modifiers without the lock keys, so that it
+ * only has to look at the ones that match.  Every key maps to the
+ * list of bindings grabbed with it.
+ */
+static gint64 *
+binding_index_key (guint keycode, guint modifiers)
+{
+	gint64 *key = g_new (gint64, 1);
+
+	*key = ((gint64) keycode << 32) | modifiers;
+	return key;
 }
 
 static void
-grab_ungrab_with_ignorable_modifiers (GdkWindow *rootwin, 
-				      Binding   *binding,
-				      gboolean   grab)
+binding_index_add (Binding *binding)
+{
+	gint64 *key = binding_index_key (binding->keycode, binding->modifiers);
+	GSList *list;
+
+	if (binding_index == NULL)
+		binding_index = g_hash_table_new_full (g_int64_hash,
+						       g_int64_equal,
+						       g_free,
+						       NULL);
+
+	list = g_hash_table_lookup (binding_index, key);
+	list = g_slist_append (list, binding);
+	g_hash_table_replace (binding_index, key, list);
+}
+
+static void
+binding_index_remove (Binding *binding)
+{
+	gint64 key = ((gint64) binding->keycode << 32) | binding->modifiers;
+	GSList *list;
+
+	if (binding_index == NULL)
+		return;
+
+	list = g_hash_table_lookup (binding_index, &key);
+	list = g_slist_remove (list, binding);
+
+	if (list != NULL)
+		g_hash_table_replace (binding_index,
+				      binding_index_key (binding->keycode,
+							 binding->modifiers),
+				      list);
+	else
+		g_hash_table_remove (binding_index, &key);
+}
+
+/*
+ * Grabs and ungrabs are queued and sent together in one flush.  Each
+ * request remembers the keycode and masks it was queued with, as they
+ * may have been re-resolved by the time it goes out.
+ */
+typedef struct _GrabRequest {
+	Binding  *binding;
+	gboolean  grab;
+	guint     keycode;
+	guint     mod_masks [8];
+} GrabRequest;
+
+static GArray *grab_queue = NULL;
+static guint flush_id = 0;
+
+static void update_filter (void);
+
+static void
+queue_grab (Binding *binding, gboolean grab)
+{
+	GrabRequest request;
+	guint i;
+
+	/* Never resolved, so there is nothing to grab with */
+	if (binding->keycode == 0)
+		return;
+
+	request.binding = binding;
+	request.grab = grab;
+	request.keycode = binding->keycode;
+	request.mod_masks [0] = 0; /* modifier only */
+	request.mod_masks [1] = num_lock_mask;
+	request.mod_masks [2] = caps_lock_mask;
+	request.mod_masks [3] = scroll_lock_mask;
+	request.mod_masks [4] = num_lock_mask  | caps_lock_mask;
+	request.mod_masks [5] = num_lock_mask  | scroll_lock_mask;
+	request.mod_masks [6] = caps_lock_mask | scroll_lock_mask;
+	request.mod_masks [7] = num_lock_mask  | caps_lock_mask | scroll_lock_mask;
+
+	for (i = 0; i < G_N_ELEMENTS (request.mod_masks); i++)
+		request.mod_masks [i] |= binding->modifiers;
+
+	if (grab_queue == NULL)
+		grab_queue = g_array_new (FALSE, FALSE, sizeof (GrabRequest));
+
+	g_array_append_val (grab_queue, request);
+}
+
+static void
+send_request (Display *display, Window xid, const GrabRequest *request, gboolean grab)
 {
-	guint mod_masks [] = {
-		0, /* modifier only */
-		num_lock_mask,
-		caps_lock_mask,
-		scroll_lock_mask,
-		num_lock_mask  | caps_lock_mask,
-		num_lock_mask  | scroll_lock_mask,
-		caps_lock_mask | scroll_lock_mask,
-		num_lock_mask  | caps_lock_mask | scroll_lock_mask,
-	};
 	guint i;
 
-	for (i = 0; i < G_N_ELEMENTS (mod_masks); i++) {
+	for (i = 0; i < G_N_ELEMENTS (request->mod_masks); i++) {
 		if (grab) {
-			XGrabKey (GDK_WINDOW_XDISPLAY (rootwin), 
-				  binding->keycode, 
-				  binding->modifiers | mod_masks [i], 
-				  GDK_WINDOW_XID (rootwin), 
+			XGrabKey (display, 
+				  request->keycode, 
+				  request->mod_masks [i], 
+				  xid, 
 				  False, 
 				  GrabModeAsync,
 				  GrabModeAsync);
 		} else {
-			XUngrabKey (GDK_WINDOW_XDISPLAY (rootwin),
-				    binding->keycode,
-				    binding->modifiers | mod_masks [i], 
-				    GDK_WINDOW_XID (rootwin));
+			XUngrabKey (display,
+				    request->keycode,
+				    request->mod_masks [i], 
+				    xid);
 		}
 	}
 }
 
+/* The binding is going away, so the requests for it still
+   queued can't point at it any more */
+static void
+forget_binding (Binding *binding)
+{
+	guint i;
+
+	if (grab_queue == NULL)
+		return;
+
+	for (i = 0; i < grab_queue->len; i++) {
+		GrabRequest *request = &g_array_index (grab_queue, GrabRequest, i);
+		if (request->binding == binding)
+			request->binding = NULL;
+	}
+}
+
+static void
+remove_binding (Binding *binding)
+{
+	bindings = g_slist_remove (bindings, binding);
+	binding_index_remove (binding);
+	forget_binding (binding);
+	update_filter ();
+
+	g_free (binding->keystring);
+	g_free (binding);
+}
+
+/*
+ * The whole batch goes out under one error trap, which costs a
+ * single round trip.  A key is usually only turned down because
+ * something else holds it already, so when the trap catches an
+ * error the grabs are tried again one at a time to find out
+ * which.  A binding that can't be grabbed is dropped, along with
+ * whatever of its masks did get through.
+ */
+static void
+flush_grabs (void)
+{
+	GdkWindow *rootwin = gdk_get_default_root_window ();
+	GdkDisplay *gdisplay = gdk_window_get_display (rootwin);
+	Display *display = GDK_WINDOW_XDISPLAY (rootwin);
+	Window xid = GDK_WINDOW_XID (rootwin);
+	GArray *batch;
+	guint i;
+
+	if (grab_queue == NULL || grab_queue->len == 0)
+		return;
+
+	/* Failed bindings are removed from the queue as it is read */
+	batch = grab_queue;
+	grab_queue = NULL;
+
+	gdk_x11_display_error_trap_push (gdisplay);
+	for (i = 0; i < batch->len; i++) {
+		GrabRequest *request = &g_array_index (batch, GrabRequest, i);
+		send_request (display, xid, request, request->grab);
+	}
+	if (gdk_x11_display_error_trap_pop (gdisplay) == 0) {
+		g_array_free (batch, TRUE);
+		return;
+	}
+
+	for (i = 0; i < batch->len; i++) {
+		GrabRequest *request = &g_array_index (batch, GrabRequest, i);
+		Binding *binding = request->binding;
+		guint j;
+
+		if (!request->grab || binding == NULL)
+			continue;
+
+		gdk_x11_display_error_trap_push (gdisplay);
+		send_request (display, xid, request, TRUE);
+		if (gdk_x11_display_error_trap_pop (gdisplay) == 0)
+			continue;
+
+		g_warning ("Binding '%s' failed!", binding->keystring);
+
+		gdk_x11_display_error_trap_push (gdisplay);
+		send_request (display, xid, request, FALSE);
+		gdk_x11_display_error_trap_pop_ignored (gdisplay);
+
+		/* Later requests in the batch are for it too */
+		for (j = i + 1; j < batch->len; j++) {
+			GrabRequest *later = &g_array_index (batch, GrabRequest, j);
+			if (later->binding == binding)
+				later->binding = NULL;
+		}
+		remove_binding (binding);
+	}
+
+	g_array_free (batch, TRUE);
+}
+
+static gboolean
+flush_grabs_idle (gpointer data G_GNUC_UNUSED)
+{
+	flush_id = 0;
+	flush_grabs ();
+
+	return FALSE;
+}
+
+/* Binding several keys in a row sends them all together */
+static void
+schedule_flush (void)
+{
+	if (flush_id == 0)
+		flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+					    flush_grabs_idle,
+					    NULL, NULL);
+}
+
+/* Works out the binding's keycode and modifiers */
 static gboolean 
-do_grab_key (Binding *binding)
+resolve_key (Binding *binding)
 {
 	GdkKeymap *keymap = gdk_keymap_get_default ();
 	GdkWindow *rootwin = gdk_get_default_root_window ();
@@ -132,32 +360,37 @@ do_grab_key (Binding *binding)
 
 	TRACE (g_print ("Got modmask %d\n", binding->modifiers));
 
-	gdk_error_trap_push ();
-
-	grab_ungrab_with_ignorable_modifiers (rootwin, 
-					      binding, 
-					      TRUE /* grab */);
+	return TRUE;
+}
 
-	gdk_flush ();
+static gboolean 
+do_grab_key (Binding *binding)
+{
+	APPLET_PROBE (grab_key, binding->keystring);
 
-	if (gdk_error_trap_pop ()) {
-	   g_warning ("Binding '%s' failed!\n", binding->keystring);
-	   return FALSE;
+	if (!resolve_key (binding)) {
+		APPLET_PROBE (grab_key_done, binding->keystring, 0, 0, TRUE);
+		return FALSE;
 	}
 
+	queue_grab (binding, TRUE /* grab */);
+	schedule_flush ();
+
+	/* The grab goes out with the next flush, which drops the
+	   binding if the server turns it down */
+	APPLET_PROBE (grab_key_done, binding->keystring,
+		      binding->keycode, binding->modifiers, FALSE);
+
 	return TRUE;
 }
 
 static gboolean 
 do_ungrab_key (Binding *binding)
 {
-	GdkWindow *rootwin = gdk_get_default_root_window ();
-
 	TRACE (g_print ("Removing grab for '%s'\n", binding->keystring));
 
-	grab_ungrab_with_ignorable_modifiers (rootwin, 
-					      binding, 
-					      FALSE /* ungrab */);
+	queue_grab (binding, FALSE /* ungrab */);
+	schedule_flush ();
 
 	return TRUE;
 }
@@ -166,86 +399,163 @@ static GdkFilterReturn
 filter_func (GdkXEvent *gdk_xevent, GdkEvent *event G_GNUC_UNUSED,
              gpointer data G_GNUC_UNUSED)
 {
-	GdkFilterReturn return_val = GDK_FILTER_CONTINUE;
 	XEvent *xevent = (XEvent *) gdk_xevent;
 	guint event_mods;
-	GSList *iter;
+	gint64 key;
+	GSList *iter, *next;
 
-	TRACE (g_print ("Got Event! %d, %d\n", xevent->type, event->type));
-
-	switch (xevent->type) {
-	case KeyPress:
-		TRACE (g_print ("Got KeyPress! keycode: %d, modifiers: %d\n", 
-				xevent->xkey.keycode, 
-				xevent->xkey.state));
-
-		/* 
-		 * Set the last event time for use when showing
-		 * windows to avoid anti-focus-stealing code.
-		 */
-		processing_event = TRUE;
-		last_event_time = xevent->xkey.time;
-
-		event_mods = xevent->xkey.state & ~(num_lock_mask  | 
-						    caps_lock_mask | 
-						    scroll_lock_mask);
-
-		for (iter = bindings; iter != NULL; iter = iter->next) {
-			Binding *binding = (Binding *) iter->data;
-						       
-			if (binding->keycode == xevent->xkey.keycode &&
-			    binding->modifiers == event_mods) {
-
-				TRACE (g_print ("Calling handler for '%s'...\n", 
-						binding->keystring));
-
-				(binding->handler) (binding->keystring, 
-						    binding->user_data);
-			}
-		}
+	/* Everything that reaches the root window comes through here */
+	if (xevent->type != KeyPress)
+		return GDK_FILTER_CONTINUE;
 
-		processing_event = FALSE;
-		break;
-	case KeyRelease:
-		TRACE (g_print ("Got KeyRelease! \n"));
-		break;
+	APPLET_PROBE (filter_key, xevent->xkey.keycode, xevent->xkey.state);
+
+	TRACE (g_print ("Got KeyPress! keycode: %d, modifiers: %d\n", 
+			xevent->xkey.keycode, 
+			xevent->xkey.state));
+
+	/* 
+	 * Set the last event time for use when showing
+	 * windows to avoid anti-focus-stealing code.
+	 */
+	processing_event = TRUE;
+	last_event_time = xevent->xkey.time;
+
+	event_mods = xevent->xkey.state & ~(num_lock_mask  | 
+					    caps_lock_mask | 
+					    scroll_lock_mask);
+
+	key = ((gint64) xevent->xkey.keycode << 32) | event_mods;
+
+	iter = binding_index != NULL ?
+		g_hash_table_lookup (binding_index, &key) : NULL;
+
+	for (; iter != NULL; iter = next) {
+		Binding *binding = (Binding *) iter->data;
+
+		/* The handler may unbind itself */
+		next = iter->next;
+
+		TRACE (g_print ("Calling handler for '%s'...\n", 
+				binding->keystring));
+
+		(binding->handler) (binding->keystring, 
+				    binding->user_data);
 	}
 
-	return return_val;
+	processing_event = FALSE;
+
+	APPLET_PROBE (filter_key_done, xevent->xkey.keycode, xevent->xkey.state);
+
+	return GDK_FILTER_CONTINUE;
 }
 
-static void 
-keymap_changed (GdkKeymap *map G_GNUC_UNUSED)
+/*
+ * The filter is only on the root window while there are
+ * bindings for it to look for.
+ */
+static void
+update_filter (void)
+{
+	GdkWindow *rootwin = gdk_get_default_root_window ();
+	gboolean wanted = (bindings != NULL);
+
+	if (wanted == filter_installed)
+		return;
+
+	if (wanted)
+		gdk_window_add_filter (rootwin, filter_func, NULL);
+	else
+		gdk_window_remove_filter (rootwin, filter_func, NULL);
+
+	filter_installed = wanted;
+}
+
+/*
+ * Resolves every binding again and only regrabs the ones that
+ * came out different.  If the lock keys moved, every grab was
+ * made with the wrong masks and all of them have to be redone.
+ */
+static gboolean
+regrab_keys (gpointer data G_GNUC_UNUSED)
 {
 	GdkKeymap *keymap = gdk_keymap_get_default ();
+	guint num_lock, caps_lock, scroll_lock;
+	gboolean locks_changed;
+	GSList *changed = NULL;
 	GSList *iter;
 
-	TRACE (g_print ("Keymap changed! Regrabbing keys..."));
+	keymap_changed_id = 0;
+
+	lookup_ignorable_modifiers (keymap, &num_lock, &caps_lock, &scroll_lock);
+
+	locks_changed = (num_lock != num_lock_mask ||
+			 caps_lock != caps_lock_mask ||
+			 scroll_lock != scroll_lock_mask);
 
 	for (iter = bindings; iter != NULL; iter = iter->next) {
 		Binding *binding = (Binding *) iter->data;
-		do_ungrab_key (binding);
+		Binding resolved = *binding;
+
+		if (!resolve_key (&resolved))
+			resolved.keycode = resolved.modifiers = 0;
+
+		if (!locks_changed &&
+		    resolved.keycode == binding->keycode &&
+		    resolved.modifiers == binding->modifiers)
+			continue;
+
+		TRACE (g_print ("Regrabbing '%s'\n", binding->keystring));
+
+		/* Goes out with the keycode and masks it was grabbed with */
+		queue_grab (binding, FALSE /* ungrab */);
+		binding_index_remove (binding);
+
+		binding->keycode = resolved.keycode;
+		binding->modifiers = resolved.modifiers;
+		changed = g_slist_prepend (changed, binding);
 	}
 
-	lookup_ignorable_modifiers (keymap);
+	num_lock_mask = num_lock;
+	caps_lock_mask = caps_lock;
+	scroll_lock_mask = scroll_lock;
 
-	for (iter = bindings; iter != NULL; iter = iter->next) {
+	for (iter = changed; iter != NULL; iter = iter->next) {
 		Binding *binding = (Binding *) iter->data;
-		do_grab_key (binding);
+		queue_grab (binding, TRUE /* grab */);
+		binding_index_add (binding);
 	}
+
+	flush_grabs ();
+	g_slist_free (changed);
+
+	return FALSE;
+}
+
+static void 
+keymap_changed (GdkKeymap *map G_GNUC_UNUSED)
+{
+	TRACE (g_print ("Keymap changed! Regrabbing keys..."));
+
+	modifier_keycodes_valid = FALSE;
+
+	if (keymap_changed_id != 0)
+		g_source_remove (keymap_changed_id);
+
+	keymap_changed_id = g_timeout_add (KEYMAP_CHANGED_DELAY,
+					   regrab_keys,
+					   NULL);
 }
 
 void 
 tomboy_keybinder_init (void)
 {
 	GdkKeymap *keymap = gdk_keymap_get_default ();
-	GdkWindow *rootwin = gdk_get_default_root_window ();
 
-	lookup_ignorable_modifiers (keymap);
-
-	gdk_window_add_filter (rootwin, 
-			       filter_func, 
-			       NULL);
+	lookup_ignorable_modifiers (keymap,
+				    &num_lock_mask,
+				    &caps_lock_mask,
+				    &scroll_lock_mask);
 
 	g_signal_connect (keymap, 
 			  "keys_changed",
@@ -266,11 +576,13 @@ tomboy_keybinder_bind (const char           *keystring,
 	binding->handler = handler;
 	binding->user_data = user_data;
 
-	/* Sets the binding's keycode and modifiers */
+	/* Sets the binding's keycode and modifiers and queues its grab */
 	success = do_grab_key (binding);
 
 	if (success) {
 		bindings = g_slist_prepend (bindings, binding);
+		binding_index_add (binding);
+		update_filter ();
 	} else {
 		g_free (binding->keystring);
 		g_free (binding);
@@ -291,11 +603,7 @@ tomboy_keybinder_unbind (const char           *keystring,
 			continue;
 
 		do_ungrab_key (binding);
-
-		bindings = g_slist_remove (bindings, binding);
-
-		g_free (binding->keystring);
-		g_free (binding);
+		remove_binding (binding);
 		break;
 	}
 }
@@ -303,30 +611,46 @@ tomboy_keybinder_unbind (const char           *keystring,
 /* 
  * From eggcellrenderkeys.c.
  */
-gboolean
-tomboy_keybinder_is_modifier (guint keycode)
+static void
+load_modifier_keycodes (void)
 {
 	gint i;
 	gint map_size;
 	XModifierKeymap *mod_keymap;
-	gboolean retval = FALSE;
 
 	mod_keymap = XGetModifierMapping (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()));
 
+	memset (modifier_keycodes, 0, sizeof (modifier_keycodes));
+
 	map_size = 8 * mod_keymap->max_keypermod;
 
-	i = 0;
-	while (i < map_size) {
-		if (keycode == mod_keymap->modifiermap[i]) {
-			retval = TRUE;
-			break;
-		}
-		++i;
+	for (i = 0; i < map_size; i++) {
+		KeyCode keycode = mod_keymap->modifiermap [i];
+
+		/* Unused slots are zero */
+		if (keycode != 0)
+			modifier_keycodes [keycode / 8] |= 1 << (keycode % 8);
 	}
 
 	XFreeModifiermap (mod_keymap);
 
-	return retval;
+	modifier_keycodes_valid = TRUE;
+}
+
+/*
+ * The modifier keycodes are fetched once and kept until the
+ * keymap changes, so this is cheap enough for every key event.
+ */
+gboolean
+tomboy_keybinder_is_modifier (guint keycode)
+{
+	if (keycode >= 256)
+		return FALSE;
+
+	if (!modifier_keycodes_valid)
+		load_modifier_keycodes ();
+
+	return (modifier_keycodes [keycode / 8] & (1 << (keycode % 8))) != 0;
 }
 
 guint32